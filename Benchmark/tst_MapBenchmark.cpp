@@ -1,12 +1,28 @@
 
 #include "../Bushy/include/splay_map.h"
+#include "../Bushy/include/prefix_splay_map.h"
+#include "../Bushy/include/arena_splay_map.h"
+#include "../Bushy/include/thread_cached_allocator.h"
+#include "../Bushy/include/huge_page_allocator.h"
+#include "../Bushy/include/shared_node_pool.h"
+#include "../Bushy/include/splay_soa_map.h"
 
 #include <QString>
 #include <QtTest>
 #include <QCoreApplication>
 
+#include <array>
 #include <map>
 #include <random>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
 
 class MapBenchmark : public QObject
 {
@@ -22,18 +38,71 @@ private Q_SLOTS:
     void testFindUniform_data();
     void testFindUniform();
 
+    void testFindUniformHugePages_data();
+    void testFindUniformHugePages();
+
+    void testFindUniformAligned_data();
+    void testFindUniformAligned();
+
     void testFindBinomialDistribution_data();
     void testFindBinomialDistribution();
 
     void testFindGeometricDistribution_data();
     void testFindGeometricDistribution();
 
+    void testInsertBatchUniform_data();
+    void testInsertBatchUniform();
+
+    void testIterateUniform_data();
+    void testIterateUniform();
+
+    void testFindPathKeys_data();
+    void testFindPathKeys();
+
+    void testShortLivedMaps_data();
+    void testShortLivedMaps();
+
+    void testClear_data();
+    void testClear();
+
+    void testThreadChurn_data();
+    void testThreadChurn();
+
+    void testManyMaps_data();
+    void testManyMaps();
+
+    void testRefresh_data();
+    void testRefresh();
+
+    void testFindCursor_data();
+    void testFindCursor();
+
+    void testInsertHint_data();
+    void testInsertHint();
+
+    void testEraseUniform_data();
+    void testEraseUniform();
+
+    void testEraseScanBursts_data();
+    void testEraseScanBursts();
+
 private:
     enum EMapType : int
     {
         E_STL_MAP,
         E_SPLAY_MAP,
-        E_SPLAY_MAP_CLASSIC
+        E_SPLAY_MAP_CLASSIC,
+        E_SPLAY_MAP_ALWAYS,
+        E_SPLAY_MAP_TOP_DOWN,
+        E_SPLAY_MAP_PREFETCH,
+        E_SPLAY_MAP_NEVER,
+        E_PREFIX_SPLAY_MAP,
+        E_ARENA_SPLAY_MAP,
+        E_SOA_SPLAY_MAP,
+        E_SPLAY_MAP_UNLINK,
+        E_SPLAY_MAP_UNLINK_SPLAY_PARENT,
+        E_SPLAY_MAP_TOMBSTONE,
+        E_SPLAY_MAP_DEFERRED
     };
 
     template<typename Map>
@@ -42,13 +111,176 @@ private:
     template<typename Map>
     void testFindUniform_impl(int size);
 
+    template<typename Map>
+    void testFindUniformHugePages_impl(Map& map, int size);
+
+    template<bushy::node_alignment Alignment>
+    void testFindUniformAligned_impl(int size);
+
     template<typename Map>
     void testFindBinomialDistribution_impl(int size);
 
     template<typename Map>
     void testFindGeometricDistribution_impl(int size);
+
+    template<typename Map>
+    void testInsertBatchUniform_impl(int size, int batch_size, bool use_batch);
+
+    template<typename Map>
+    void testIterateUniform_impl(int size, bool use_visitor);
+
+    template<typename Map>
+    void testFindPathKeys_impl(int size);
+
+    template<typename Map>
+    void testThreadChurn_impl(int threads);
+
+    template<typename Map, typename Allocator>
+    void testManyMaps_impl(int size, const Allocator& allocator);
+
+    template<typename Map>
+    void testFindCursor_impl(int size, bool use_hint);
+
+    enum EHintType : int
+    {
+        E_HINT_END,
+        E_HINT_PREVIOUS,
+        E_HINT_NEAR
+    };
+
+    template<typename Map>
+    void testInsertHint_impl(int size, int hint_type);
+
+    template<typename Map>
+    void testEraseUniform_impl(int size);
+
+    template<typename Map>
+    void testEraseScanBursts_impl(int size);
+};
+
+// Counter of the load misses (data TLB, or last level cache) of the calling thread.
+// Counter uses the perf events (Linux only), it is not available on other systems, and
+// also when the hardware counters are not accessible (for example in virtual machines).
+class cache_miss_counter
+{
+public:
+    enum cache_type
+    {
+        DATA_TLB,
+        LAST_LEVEL_CACHE
+    };
+
+    explicit cache_miss_counter(cache_type type) : _descriptor(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = (type == DATA_TLB ? PERF_COUNT_HW_CACHE_DTLB : PERF_COUNT_HW_CACHE_LL) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        _descriptor = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#else
+        Q_UNUSED(type);
+#endif
+    }
+
+    ~cache_miss_counter()
+    {
+#ifdef __linux__
+        if (_descriptor != -1)
+        {
+            close(_descriptor);
+        }
+#endif
+    }
+
+    bool is_available() const { return _descriptor != -1; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (is_available())
+        {
+            ioctl(_descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(_descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Returns count of misses since start, or -1, if counter is not available
+    long long stop()
+    {
+        long long count = -1;
+#ifdef __linux__
+        if (is_available())
+        {
+            ioctl(_descriptor, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(_descriptor, &count, sizeof(count)) != sizeof(count))
+            {
+                count = -1;
+            }
+        }
+#endif
+        return count;
+    }
+
+private:
+    int _descriptor;
 };
 
+// Inserts the range into the map, for splay map also using the batch insertion
+template<typename Map>
+static void insert_range(Map& map, const std::vector<std::pair<int, int>>& range, bool)
+{
+    map.insert(range.cbegin(), range.cend());
+}
+
+template<typename Key, typename T>
+static void insert_range(bushy::splay_map<Key, T>& map, const std::vector<std::pair<int, int>>& range, bool use_batch)
+{
+    if (use_batch)
+    {
+        map.insert_batch(range.cbegin(), range.cend());
+    }
+    else
+    {
+        map.insert(range.cbegin(), range.cend());
+    }
+}
+
+// Sums the values of the map, for splay map also using the visitor
+template<typename Map>
+static long long sum_values(const Map& map, bool)
+{
+    long long sum = 0;
+    for (const auto& item : map)
+    {
+        sum += item.second;
+    }
+    return sum;
+}
+
+template<typename Key, typename T>
+static long long sum_values(const bushy::splay_map<Key, T>& map, bool use_visitor)
+{
+    long long sum = 0;
+    if (use_visitor)
+    {
+        map.for_each([&sum](const typename bushy::splay_map<Key, T>::value_type& item) { sum += item.second; });
+    }
+    else
+    {
+        for (const auto& item : map)
+        {
+            sum += item.second;
+        }
+    }
+    return sum;
+}
+
 MapBenchmark::MapBenchmark()
 {
 }
@@ -64,6 +296,9 @@ void MapBenchmark::testInsertFindDeleteUniform_data()
         QTest::newRow("STL Map (" + size + " elements)") << (int)E_STL_MAP << i;
         QTest::newRow("Splay Map (" + size + " elements)") << (int)E_SPLAY_MAP << i;
         QTest::newRow("Splay Map Classic (" + size + " elements)") << (int)E_SPLAY_MAP_CLASSIC << i;
+        QTest::newRow("Splay Map Always (" + size + " elements)") << (int)E_SPLAY_MAP_ALWAYS << i;
+        QTest::newRow("Splay Map Top-Down (" + size + " elements)") << (int)E_SPLAY_MAP_TOP_DOWN << i;
+        QTest::newRow("Splay SoA Map (" + size + " elements)") << (int)E_SOA_SPLAY_MAP << i;
     }
 }
 
@@ -86,6 +321,18 @@ void MapBenchmark::testInsertFindDeleteUniform()
             testInsertFindDeleteUniform_impl<bushy::splay_classic_map<int, int>>(size);
             break;
 
+        case E_SPLAY_MAP_ALWAYS:
+            testInsertFindDeleteUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::ALWAYS, bushy::splay_mode::ALWAYS>>>(size);
+            break;
+
+        case E_SPLAY_MAP_TOP_DOWN:
+            testInsertFindDeleteUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::TOP_DOWN, bushy::splay_mode::ALWAYS>>>(size);
+            break;
+
+        case E_SOA_SPLAY_MAP:
+            testInsertFindDeleteUniform_impl<bushy::splay_soa_map<int, int>>(size);
+            break;
+
         default:
             QVERIFY2(false, "Unknown map type!");
             break;
@@ -137,6 +384,10 @@ void MapBenchmark::testFindUniform_data()
         QTest::newRow("STL Map (" + size + " elements)") << (int)E_STL_MAP << i;
         QTest::newRow("Splay Map (" + size + " elements)") << (int)E_SPLAY_MAP << i;
         QTest::newRow("Splay Map Classic (" + size + " elements)") << (int)E_SPLAY_MAP_CLASSIC << i;
+        QTest::newRow("Splay Map Always (" + size + " elements)") << (int)E_SPLAY_MAP_ALWAYS << i;
+        QTest::newRow("Splay Map Prefetch (" + size + " elements)") << (int)E_SPLAY_MAP_PREFETCH << i;
+        QTest::newRow("Splay SoA Map (" + size + " elements)") << (int)E_SOA_SPLAY_MAP << i;
+        QTest::newRow("Splay Map Deferred (" + size + " elements)") << (int)E_SPLAY_MAP_DEFERRED << i;
     }
 }
 
@@ -159,6 +410,22 @@ void MapBenchmark::testFindUniform()
             testFindUniform_impl<bushy::splay_classic_map<int, int>>(size);
             break;
 
+        case E_SPLAY_MAP_ALWAYS:
+            testFindUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::ALWAYS, bushy::splay_mode::ALWAYS>>>(size);
+            break;
+
+        case E_SPLAY_MAP_PREFETCH:
+            testFindUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::CHILDREN>>>(size);
+            break;
+
+        case E_SOA_SPLAY_MAP:
+            testFindUniform_impl<bushy::splay_soa_map<int, int>>(size);
+            break;
+
+        case E_SPLAY_MAP_DEFERRED:
+            testFindUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::DEFERRED>>>(size);
+            break;
+
         default:
             QVERIFY2(false, "Unknown map type!");
             break;
@@ -198,6 +465,163 @@ void MapBenchmark::testFindUniform_impl(int size)
     }
 }
 
+void MapBenchmark::testFindUniformHugePages_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("use_huge_pages");
+
+    for (const int i : { 1000000, 10000000 })
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("Splay Map (" + size + " elements)") << i << false;
+        QTest::newRow("Splay Map huge page arena (" + size + " elements)") << i << true;
+    }
+}
+
+void MapBenchmark::testFindUniformHugePages()
+{
+    QFETCH(int, size);
+    QFETCH(bool, use_huge_pages);
+
+    if (use_huge_pages)
+    {
+        bushy::huge_page_arena arena;
+        bushy::splay_map<int, int, std::less<int>, bushy::huge_page_allocator<std::pair<const int, int>>> map(&arena);
+        testFindUniformHugePages_impl(map, size);
+    }
+    else
+    {
+        bushy::splay_map<int, int> map;
+        testFindUniformHugePages_impl(map, size);
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testFindUniformHugePages_impl(Map& map, int size)
+{
+    // Prepare the test data
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::random_shuffle(data.begin(), data.end());
+
+    // Insert the data
+    for (const int value : data)
+    {
+        map.insert(std::make_pair(value, value * 37));
+    }
+
+    cache_miss_counter counter(cache_miss_counter::DATA_TLB);
+    long long misses = -1;
+
+    QBENCHMARK {
+        // Find all data
+        std::random_shuffle(data.begin(), data.end());
+
+        counter.start();
+        for (const int value : data)
+        {
+            volatile auto it = map.find(value);
+            Q_UNUSED(it);
+        }
+        misses = counter.stop();
+    }
+
+    if (counter.is_available())
+    {
+        qDebug() << "dTLB load misses:" << misses;
+    }
+    else
+    {
+        qDebug() << "dTLB load misses: counter is not available";
+    }
+}
+
+void MapBenchmark::testFindUniformAligned_data()
+{
+    QTest::addColumn<int>("alignment");
+    QTest::addColumn<int>("size");
+
+    for (const int i : { 100000, 1000000 })
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("Splay Map natural nodes (" + size + " elements)") << (int)bushy::node_alignment::NATURAL << i;
+        QTest::newRow("Splay Map 32 byte aligned nodes (" + size + " elements)") << (int)bushy::node_alignment::HALF_LINE << i;
+        QTest::newRow("Splay Map 64 byte aligned nodes (" + size + " elements)") << (int)bushy::node_alignment::CACHE_LINE << i;
+    }
+}
+
+void MapBenchmark::testFindUniformAligned()
+{
+    QFETCH(int, alignment);
+    QFETCH(int, size);
+
+    switch (static_cast<bushy::node_alignment>(alignment))
+    {
+        case bushy::node_alignment::NATURAL:
+            testFindUniformAligned_impl<bushy::node_alignment::NATURAL>(size);
+            break;
+
+        case bushy::node_alignment::HALF_LINE:
+            testFindUniformAligned_impl<bushy::node_alignment::HALF_LINE>(size);
+            break;
+
+        case bushy::node_alignment::CACHE_LINE:
+            testFindUniformAligned_impl<bushy::node_alignment::CACHE_LINE>(size);
+            break;
+    }
+}
+
+template<bushy::node_alignment Alignment>
+void MapBenchmark::testFindUniformAligned_impl(int size)
+{
+    // Value of 12 bytes makes the natural node 40 bytes long, so some nodes
+    // straddle the cache line boundary. Arena carves the nodes densely, so only
+    // the node alignment affects the layout.
+    typedef std::array<int, 3> Value;
+    typedef bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, Alignment> Policy;
+    typedef bushy::splay_map<int, Value, std::less<int>, bushy::huge_page_allocator<std::pair<const int, Value>>, Policy> Map;
+
+    bushy::huge_page_arena arena;
+    Map map(&arena);
+
+    // Prepare the test data
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::random_shuffle(data.begin(), data.end());
+
+    // Insert the data
+    for (const int value : data)
+    {
+        map.insert(std::make_pair(value, Value{ { value, value * 37, value * 41 } }));
+    }
+
+    cache_miss_counter counter(cache_miss_counter::LAST_LEVEL_CACHE);
+    long long misses = -1;
+
+    QBENCHMARK {
+        // Find all data
+        std::random_shuffle(data.begin(), data.end());
+
+        counter.start();
+        for (const int value : data)
+        {
+            volatile auto it = map.find(value);
+            Q_UNUSED(it);
+        }
+        misses = counter.stop();
+    }
+
+    qDebug() << "Node size:" << Map::memory_consumption_item();
+    if (counter.is_available())
+    {
+        qDebug() << "LLC load misses:" << misses;
+    }
+    else
+    {
+        qDebug() << "LLC load misses: counter is not available";
+    }
+}
+
 void MapBenchmark::testFindBinomialDistribution_data()
 {
     QTest::addColumn<int>("map_type");
@@ -284,6 +708,7 @@ void MapBenchmark::testFindGeometricDistribution_data()
         QTest::newRow("STL Map (" + size + " elements)") << (int)E_STL_MAP << i;
         QTest::newRow("Splay Map (" + size + " elements)") << (int)E_SPLAY_MAP << i;
         QTest::newRow("Splay Map Classic (" + size + " elements)") << (int)E_SPLAY_MAP_CLASSIC << i;
+        QTest::newRow("Splay Map Deferred (" + size + " elements)") << (int)E_SPLAY_MAP_DEFERRED << i;
     }
 }
 
@@ -306,6 +731,10 @@ void MapBenchmark::testFindGeometricDistribution()
             testFindGeometricDistribution_impl<bushy::splay_classic_map<int, int>>(size);
             break;
 
+        case E_SPLAY_MAP_DEFERRED:
+            testFindGeometricDistribution_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::DEFERRED>>>(size);
+            break;
+
         default:
             QVERIFY2(false, "Unknown map type!");
             break;
@@ -348,6 +777,810 @@ void MapBenchmark::testFindGeometricDistribution_impl(int size)
     }
 }
 
+void MapBenchmark::testInsertBatchUniform_data()
+{
+    QTest::addColumn<int>("map_type");
+    QTest::addColumn<int>("size");
+    QTest::addColumn<int>("batch_size");
+    QTest::addColumn<bool>("use_batch");
+
+    for (const int i : { 1000, 10000, 100000, 1000000})
+    {
+        for (const int batch : { i / 100, i })
+        {
+            QByteArray size = QByteArray::number(i) + " elements, batch " + QByteArray::number(batch);
+            QTest::newRow("STL Map (" + size + ")") << (int)E_STL_MAP << i << batch << false;
+            QTest::newRow("Splay Map (" + size + ")") << (int)E_SPLAY_MAP << i << batch << false;
+            QTest::newRow("Splay Map insert_batch (" + size + ")") << (int)E_SPLAY_MAP << i << batch << true;
+        }
+    }
+}
+
+void MapBenchmark::testInsertBatchUniform()
+{
+    QFETCH(int, map_type);
+    QFETCH(int, size);
+    QFETCH(int, batch_size);
+    QFETCH(bool, use_batch);
+
+    switch (map_type)
+    {
+        case E_STL_MAP:
+            testInsertBatchUniform_impl<std::map<int, int>>(size, batch_size, use_batch);
+            break;
+
+        case E_SPLAY_MAP:
+            testInsertBatchUniform_impl<bushy::splay_map<int, int>>(size, batch_size, use_batch);
+            break;
+
+        default:
+            QVERIFY2(false, "Unknown map type!");
+            break;
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testInsertBatchUniform_impl(int size, int batch_size, bool use_batch)
+{
+    // Prepare the test data, even keys are in the map, odd keys are in the batch
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 0);
+    std::random_shuffle(data.begin(), data.end());
+
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 0; i < batch_size; ++i)
+    {
+        batch.push_back(std::make_pair(data[i] * 2 + 1, i));
+    }
+
+    Map map;
+
+    // Insert the data
+    for (const int value : data)
+    {
+        map.insert(std::make_pair(value * 2, value * 37));
+    }
+
+    QBENCHMARK_ONCE {
+        // Insert the batch
+        insert_range(map, batch, use_batch);
+    }
+
+    QVERIFY(map.size() == static_cast<std::size_t>(size + batch_size));
+}
+
+void MapBenchmark::testIterateUniform_data()
+{
+    QTest::addColumn<int>("map_type");
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("use_visitor");
+
+    for (const int i : { 1000, 10000, 100000, 1000000})
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("STL Map (" + size + " elements)") << (int)E_STL_MAP << i << false;
+        QTest::newRow("Splay Map (" + size + " elements)") << (int)E_SPLAY_MAP << i << false;
+        QTest::newRow("Splay Map for_each (" + size + " elements)") << (int)E_SPLAY_MAP << i << true;
+    }
+}
+
+void MapBenchmark::testIterateUniform()
+{
+    QFETCH(int, map_type);
+    QFETCH(int, size);
+    QFETCH(bool, use_visitor);
+
+    switch (map_type)
+    {
+        case E_STL_MAP:
+            testIterateUniform_impl<std::map<int, int>>(size, use_visitor);
+            break;
+
+        case E_SPLAY_MAP:
+            testIterateUniform_impl<bushy::splay_map<int, int>>(size, use_visitor);
+            break;
+
+        default:
+            QVERIFY2(false, "Unknown map type!");
+            break;
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testIterateUniform_impl(int size, bool use_visitor)
+{
+    Map map;
+
+    // Prepare the test data
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::random_shuffle(data.begin(), data.end());
+
+    // Insert the data
+    for (const int value : data)
+    {
+        map.insert(std::make_pair(value, value));
+    }
+
+    QBENCHMARK {
+        // Iterate over all data
+        for (int i = 0; i < 10; ++i)
+        {
+            volatile long long sum = sum_values(map, use_visitor);
+            Q_UNUSED(sum);
+        }
+    }
+}
+
+void MapBenchmark::testFindPathKeys_data()
+{
+    QTest::addColumn<int>("map_type");
+    QTest::addColumn<int>("size");
+
+    for (const int i : { 1000, 10000, 100000, 1000000})
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("STL Map (" + size + " elements)") << (int)E_STL_MAP << i;
+        QTest::newRow("Splay Map (" + size + " elements)") << (int)E_SPLAY_MAP << i;
+        QTest::newRow("Prefix Splay Map (" + size + " elements)") << (int)E_PREFIX_SPLAY_MAP << i;
+        QTest::newRow("Arena Splay Map (" + size + " elements)") << (int)E_ARENA_SPLAY_MAP << i;
+    }
+}
+
+void MapBenchmark::testFindPathKeys()
+{
+    QFETCH(int, map_type);
+    QFETCH(int, size);
+
+    switch (map_type)
+    {
+        case E_STL_MAP:
+            testFindPathKeys_impl<std::map<std::string, int>>(size);
+            break;
+
+        case E_SPLAY_MAP:
+            testFindPathKeys_impl<bushy::splay_map<std::string, int>>(size);
+            break;
+
+        case E_PREFIX_SPLAY_MAP:
+            testFindPathKeys_impl<bushy::prefix_splay_map<int>>(size);
+            break;
+
+        case E_ARENA_SPLAY_MAP:
+            testFindPathKeys_impl<bushy::arena_splay_map<int>>(size);
+            break;
+
+        default:
+            QVERIFY2(false, "Unknown map type!");
+            break;
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testFindPathKeys_impl(int size)
+{
+    Map map;
+
+    // Prepare the test data - file paths with long shared prefixes
+    std::vector<std::string> data;
+    data.reserve(size);
+    for (int i = 0; i < size; ++i)
+    {
+        data.push_back("/home/user/projects/bushy/source/module" + std::to_string(i / 100) + "/include/file" + std::to_string(i) + ".h");
+    }
+    std::random_shuffle(data.begin(), data.end());
+
+    // Insert the data
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        map.insert(std::make_pair(data[i], static_cast<int>(i)));
+    }
+
+    QBENCHMARK {
+        // Find all data
+        std::random_shuffle(data.begin(), data.end());
+        for (const std::string& value : data)
+        {
+            volatile bool found = map.find(value) != map.end();
+            Q_UNUSED(found);
+        }
+    }
+}
+
+void MapBenchmark::testShortLivedMaps_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("use_monotonic");
+
+    for (const int i : { 10, 100, 1000, 10000})
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("Splay Map (" + size + " elements)") << i << false;
+        QTest::newRow("Splay Map monotonic buffer (" + size + " elements)") << i << true;
+    }
+}
+
+void MapBenchmark::testShortLivedMaps()
+{
+    QFETCH(int, size);
+    QFETCH(bool, use_monotonic);
+
+    // Prepare the test data
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::random_shuffle(data.begin(), data.end());
+
+    std::vector<char> buffer(size * 64);
+
+    QBENCHMARK {
+        // Many maps created, used and destroyed (as in the request processing)
+        for (int i = 0; i < 100000 / size; ++i)
+        {
+#ifdef BUSHY_HAS_MEMORY_RESOURCE
+            if (use_monotonic)
+            {
+                std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size());
+                bushy::pmr::splay_map<int, int> map(&resource);
+                for (const int value : data)
+                {
+                    map.insert(std::make_pair(value, value));
+                }
+
+                volatile auto found = map.find(size / 2);
+                Q_UNUSED(found);
+                continue;
+            }
+#else
+            Q_UNUSED(use_monotonic);
+#endif
+
+            bushy::splay_map<int, int> map;
+            for (const int value : data)
+            {
+                map.insert(std::make_pair(value, value));
+            }
+
+            volatile auto found = map.find(size / 2);
+            Q_UNUSED(found);
+        }
+    }
+}
+
+void MapBenchmark::testClear_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("use_monotonic");
+
+    for (const int i : { 1000, 10000, 100000, 1000000})
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("Splay Map (" + size + " elements)") << i << false;
+        QTest::newRow("Splay Map monotonic buffer (" + size + " elements)") << i << true;
+    }
+}
+
+void MapBenchmark::testClear()
+{
+    QFETCH(int, size);
+    QFETCH(bool, use_monotonic);
+
+    // Prepare the test data
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::random_shuffle(data.begin(), data.end());
+
+#ifdef BUSHY_HAS_MEMORY_RESOURCE
+    if (use_monotonic)
+    {
+        std::pmr::monotonic_buffer_resource resource;
+        bushy::pmr::splay_map<int, int> map(&resource);
+        for (const int value : data)
+        {
+            map.insert(std::make_pair(value, value));
+        }
+
+        QBENCHMARK_ONCE {
+            map.clear();
+        }
+
+        return;
+    }
+#else
+    Q_UNUSED(use_monotonic);
+#endif
+
+    bushy::splay_map<int, int> map;
+    for (const int value : data)
+    {
+        map.insert(std::make_pair(value, value));
+    }
+
+    QBENCHMARK_ONCE {
+        map.clear();
+    }
+}
+
+void MapBenchmark::testThreadChurn_data()
+{
+    QTest::addColumn<int>("threads");
+    QTest::addColumn<bool>("use_thread_cache");
+
+    for (const int i : { 1, 2, 4, 8 })
+    {
+        QByteArray threads = QByteArray::number(i);
+        QTest::newRow("Splay Map (" + threads + " threads)") << i << false;
+        QTest::newRow("Splay Map thread cached allocator (" + threads + " threads)") << i << true;
+    }
+}
+
+void MapBenchmark::testThreadChurn()
+{
+    QFETCH(int, threads);
+    QFETCH(bool, use_thread_cache);
+
+    if (use_thread_cache)
+    {
+        testThreadChurn_impl<bushy::splay_map<int, int, std::less<int>, bushy::thread_cached_allocator<std::pair<const int, int>>>>(threads);
+    }
+    else
+    {
+        testThreadChurn_impl<bushy::splay_map<int, int>>(threads);
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testThreadChurn_impl(int threads)
+{
+    QBENCHMARK {
+        // Each thread does insert/erase churn on its private map
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([i]()
+            {
+                std::minstd_rand engine(i);
+                std::uniform_int_distribution<int> distribution(0, 10000);
+
+                Map map;
+                for (int j = 0; j < 1000000; ++j)
+                {
+                    const int key = distribution(engine);
+                    if (j % 2)
+                    {
+                        map.erase(key);
+                    }
+                    else
+                    {
+                        map.insert(std::make_pair(key, j));
+                    }
+                }
+            });
+        }
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+}
+
+void MapBenchmark::testManyMaps_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("use_shared_pool");
+
+    for (const int i : { 10, 100, 1000 })
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("Splay Map (" + size + " elements)") << i << false;
+        QTest::newRow("Splay Map shared node pool (" + size + " elements)") << i << true;
+    }
+}
+
+void MapBenchmark::testManyMaps()
+{
+    QFETCH(int, size);
+    QFETCH(bool, use_shared_pool);
+
+    if (use_shared_pool)
+    {
+        bushy::shared_node_pool pool;
+        testManyMaps_impl<bushy::splay_map<int, int, std::less<int>, bushy::shared_pool_allocator<std::pair<const int, int>>>>(size, bushy::shared_pool_allocator<std::pair<const int, int>>(&pool));
+    }
+    else
+    {
+        testManyMaps_impl<bushy::splay_map<int, int>>(size, std::allocator<std::pair<const int, int>>());
+    }
+}
+
+template<typename Map, typename Allocator>
+void MapBenchmark::testManyMaps_impl(int size, const Allocator& allocator)
+{
+    std::minstd_rand engine(0);
+    std::uniform_int_distribution<int> distribution(0, 10 * size);
+
+    QBENCHMARK {
+        // Many maps (sessions) are filled, churned and destroyed in the interleaved order
+        std::vector<Map> maps;
+        for (int i = 0; i < 1000000 / size; ++i)
+        {
+            maps.emplace_back(std::less<int>(), allocator);
+        }
+
+        for (int round = 0; round < 2 * size; ++round)
+        {
+            for (Map& map : maps)
+            {
+                const int key = distribution(engine);
+                if (round % 4 == 3)
+                {
+                    map.erase(key);
+                }
+                else
+                {
+                    map.insert(std::make_pair(key, round));
+                }
+            }
+        }
+    }
+}
+
+void MapBenchmark::testRefresh_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("use_assign");
+
+    for (const int i : { 100, 10000, 1000000 })
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("Splay Map clear and insert (" + size + " elements)") << i << false;
+        QTest::newRow("Splay Map assign (" + size + " elements)") << i << true;
+    }
+}
+
+void MapBenchmark::testRefresh()
+{
+    QFETCH(int, size);
+    QFETCH(bool, use_assign);
+
+    // Prepare the test data - the new contents of the map
+    std::vector<std::pair<int, int>> data(size);
+    for (int i = 0; i < size; ++i)
+    {
+        data[i] = std::make_pair(i, i * 37);
+    }
+
+    bushy::splay_map<int, int> map(data.cbegin(), data.cend());
+
+    QBENCHMARK {
+        // Periodic full refresh of the map
+        for (int i = 0; i < 10000000 / size; ++i)
+        {
+            if (use_assign)
+            {
+                map.assign(data.cbegin(), data.cend());
+            }
+            else
+            {
+                map.clear();
+                map.insert(data.cbegin(), data.cend());
+            }
+        }
+    }
+}
+
+void MapBenchmark::testFindCursor_data()
+{
+    QTest::addColumn<int>("map_type");
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("use_hint");
+
+    for (const int i : { 10000, 1000000 })
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("Splay Map find (" + size + " elements)") << (int)E_SPLAY_MAP << i << false;
+        QTest::newRow("Splay Map find from cursor (" + size + " elements)") << (int)E_SPLAY_MAP << i << true;
+        QTest::newRow("Splay Map Never find (" + size + " elements)") << (int)E_SPLAY_MAP_NEVER << i << false;
+        QTest::newRow("Splay Map Never find from cursor (" + size + " elements)") << (int)E_SPLAY_MAP_NEVER << i << true;
+    }
+}
+
+void MapBenchmark::testFindCursor()
+{
+    QFETCH(int, map_type);
+    QFETCH(int, size);
+    QFETCH(bool, use_hint);
+
+    switch (map_type)
+    {
+        case E_SPLAY_MAP:
+            testFindCursor_impl<bushy::splay_map<int, int>>(size, use_hint);
+            break;
+
+        case E_SPLAY_MAP_NEVER:
+            testFindCursor_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::NEVER>>>(size, use_hint);
+            break;
+
+        default:
+            QVERIFY2(false, "Unknown map type!");
+            break;
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testFindCursor_impl(int size, bool use_hint)
+{
+    // Prepare the test data
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::random_shuffle(data.begin(), data.end());
+
+    Map map;
+    for (const int value : data)
+    {
+        map.insert(std::make_pair(value, value * 37));
+    }
+
+    // Cursor moves over the key space in small steps
+    std::minstd_rand engine(0);
+    std::uniform_int_distribution<int> step(-8, 8);
+    std::vector<int> keys(1000000);
+    int key = size / 2;
+    for (int& item : keys)
+    {
+        key = std::min(std::max(key + step(engine), 1), size);
+        item = key;
+    }
+
+    QBENCHMARK {
+        typename Map::const_iterator cursor = map.cend();
+        for (const int value : keys)
+        {
+            if (use_hint)
+            {
+                cursor = map.find(cursor, value);
+            }
+            else
+            {
+                cursor = map.find(value);
+            }
+        }
+
+        volatile bool found = cursor != map.cend();
+        Q_UNUSED(found);
+    }
+}
+
+void MapBenchmark::testInsertHint_data()
+{
+    QTest::addColumn<int>("map_type");
+    QTest::addColumn<int>("hint_type");
+
+    QTest::newRow("STL Map sorted, end hint") << (int)E_STL_MAP << (int)E_HINT_END;
+    QTest::newRow("Splay Map sorted, end hint") << (int)E_SPLAY_MAP << (int)E_HINT_END;
+    QTest::newRow("STL Map sorted, previous hint") << (int)E_STL_MAP << (int)E_HINT_PREVIOUS;
+    QTest::newRow("Splay Map sorted, previous hint") << (int)E_SPLAY_MAP << (int)E_HINT_PREVIOUS;
+    QTest::newRow("STL Map near, previous hint") << (int)E_STL_MAP << (int)E_HINT_NEAR;
+    QTest::newRow("Splay Map near, previous hint") << (int)E_SPLAY_MAP << (int)E_HINT_NEAR;
+}
+
+void MapBenchmark::testInsertHint()
+{
+    QFETCH(int, map_type);
+    QFETCH(int, hint_type);
+
+    switch (map_type)
+    {
+        case E_STL_MAP:
+            testInsertHint_impl<std::map<int, int>>(1000000, hint_type);
+            break;
+
+        case E_SPLAY_MAP:
+            testInsertHint_impl<bushy::splay_map<int, int>>(1000000, hint_type);
+            break;
+
+        default:
+            QVERIFY2(false, "Unknown map type!");
+            break;
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testInsertHint_impl(int size, int hint_type)
+{
+    // Prepare the keys - sorted, or moving in small steps over the key space
+    // (keys spread, so most of them are new)
+    std::vector<int> keys(size);
+    if (hint_type == E_HINT_NEAR)
+    {
+        std::minstd_rand engine(0);
+        std::uniform_int_distribution<int> step(-4, 4);
+        int key = 0;
+        for (int& item : keys)
+        {
+            key += step(engine);
+            item = key;
+        }
+    }
+    else
+    {
+        std::iota(keys.begin(), keys.end(), 1);
+    }
+
+    QBENCHMARK {
+        Map map;
+        typename Map::iterator hint = map.end();
+        for (const int key : keys)
+        {
+            if (hint_type == E_HINT_END)
+            {
+                map.emplace_hint(map.end(), key, key);
+            }
+            else
+            {
+                hint = map.emplace_hint(hint, key, key);
+            }
+        }
+    }
+}
+
+void MapBenchmark::testEraseUniform_data()
+{
+    QTest::addColumn<int>("map_type");
+    QTest::addColumn<int>("size");
+
+    for (const int i : { 100000, 1000000 })
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("STL Map (" + size + " elements)") << (int)E_STL_MAP << i;
+        QTest::newRow("Splay Map (" + size + " elements)") << (int)E_SPLAY_MAP << i;
+        QTest::newRow("Splay Map Unlink (" + size + " elements)") << (int)E_SPLAY_MAP_UNLINK << i;
+        QTest::newRow("Splay Map Unlink Splay Parent (" + size + " elements)") << (int)E_SPLAY_MAP_UNLINK_SPLAY_PARENT << i;
+        QTest::newRow("Splay Map Tombstone (" + size + " elements)") << (int)E_SPLAY_MAP_TOMBSTONE << i;
+    }
+}
+
+void MapBenchmark::testEraseUniform()
+{
+    QFETCH(int, map_type);
+    QFETCH(int, size);
+
+    switch (map_type)
+    {
+        case E_STL_MAP:
+            testEraseUniform_impl<std::map<int, int>>(size);
+            break;
+
+        case E_SPLAY_MAP:
+            testEraseUniform_impl<bushy::splay_map<int, int>>(size);
+            break;
+
+        case E_SPLAY_MAP_UNLINK:
+            testEraseUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::UNLINK>>>(size);
+            break;
+
+        case E_SPLAY_MAP_UNLINK_SPLAY_PARENT:
+            testEraseUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::UNLINK_SPLAY_PARENT>>>(size);
+            break;
+
+        case E_SPLAY_MAP_TOMBSTONE:
+            testEraseUniform_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::TOMBSTONE>>>(size);
+            break;
+
+        default:
+            QVERIFY2(false, "Unknown map type!");
+            break;
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testEraseUniform_impl(int size)
+{
+    // Prepare the test data - erased keys are random, so they are cold
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::random_shuffle(data.begin(), data.end());
+
+    std::vector<int> erased(data);
+    std::random_shuffle(erased.begin(), erased.end());
+
+    QBENCHMARK {
+        Map map;
+        for (const int value : data)
+        {
+            map.emplace_hint(map.end(), value, value);
+        }
+
+        for (const int value : erased)
+        {
+            map.erase(value);
+        }
+    }
+}
+
+void MapBenchmark::testEraseScanBursts_data()
+{
+    QTest::addColumn<int>("map_type");
+    QTest::addColumn<int>("size");
+
+    for (const int i : { 100000, 1000000 })
+    {
+        QByteArray size = QByteArray::number(i);
+        QTest::newRow("STL Map (" + size + " elements)") << (int)E_STL_MAP << i;
+        QTest::newRow("Splay Map (" + size + " elements)") << (int)E_SPLAY_MAP << i;
+        QTest::newRow("Splay Map Unlink (" + size + " elements)") << (int)E_SPLAY_MAP_UNLINK << i;
+        QTest::newRow("Splay Map Tombstone (" + size + " elements)") << (int)E_SPLAY_MAP_TOMBSTONE << i;
+    }
+}
+
+void MapBenchmark::testEraseScanBursts()
+{
+    QFETCH(int, map_type);
+    QFETCH(int, size);
+
+    switch (map_type)
+    {
+        case E_STL_MAP:
+            testEraseScanBursts_impl<std::map<int, int>>(size);
+            break;
+
+        case E_SPLAY_MAP:
+            testEraseScanBursts_impl<bushy::splay_map<int, int>>(size);
+            break;
+
+        case E_SPLAY_MAP_UNLINK:
+            testEraseScanBursts_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::UNLINK>>>(size);
+            break;
+
+        case E_SPLAY_MAP_TOMBSTONE:
+            testEraseScanBursts_impl<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::TOMBSTONE>>>(size);
+            break;
+
+        default:
+            QVERIFY2(false, "Unknown map type!");
+            break;
+    }
+}
+
+template<typename Map>
+void MapBenchmark::testEraseScanBursts_impl(int size)
+{
+    // Prepare the test data - the map is emptied by ten bursts of random erasures,
+    // each burst is followed by a scan of the whole map
+    std::vector<int> data(size);
+    std::iota(data.begin(), data.end(), 1);
+
+    std::vector<int> erased(data);
+    std::random_shuffle(erased.begin(), erased.end());
+
+    QBENCHMARK {
+        Map map;
+        for (const int value : data)
+        {
+            map.emplace_hint(map.end(), value, value);
+        }
+
+        long long sum = 0;
+        const std::size_t burst = erased.size() / 10;
+        for (std::size_t begin = 0; begin < erased.size(); begin += burst)
+        {
+            const std::size_t end = std::min(begin + burst, erased.size());
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                map.erase(erased[i]);
+            }
+
+            for (const auto& item : map)
+            {
+                sum += item.second;
+            }
+        }
+
+        volatile long long result = sum;
+        Q_UNUSED(result);
+    }
+}
+
 QTEST_MAIN(MapBenchmark)
 
 #include "tst_MapBenchmark.moc"
@@ -14,7 +14,14 @@ SOURCES += \
     splay_map_instantiation_test.cpp
 
 HEADERS += \
-    include/splay_map.h
+    include/splay_map.h \
+    include/ttl_splay_map.h \
+    include/prefix_splay_map.h \
+    include/arena_splay_map.h \
+    include/thread_cached_allocator.h \
+    include/huge_page_allocator.h \
+    include/shared_node_pool.h \
+    include/splay_soa_map.h
 unix {
     target.path = /usr/lib
     INSTALLS += target
@@ -0,0 +1,452 @@
+//**************************** LICENSE *************************************
+//
+// Bushy - various search tree implementation library
+// Copyright (C) 2016  Jakub Melka
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//**************************************************************************
+
+#ifndef BUSHY_ARENA_SPLAY_MAP_H
+#define BUSHY_ARENA_SPLAY_MAP_H
+
+#include "splay_map.h"
+
+#include <cstring>
+#include <string>
+
+#if defined(__has_include)
+#if __has_include(<string_view>) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#include <string_view>
+#define BUSHY_HAS_STRING_VIEW
+#endif
+#endif
+
+namespace bushy
+{
+
+// Key arena - storage of the key bytes. Keys are copied into large chunks, so
+// storing of the key does not allocate memory (except when the chunk is full),
+// and all memory is released at once. Stored keys are never moved.
+class key_arena
+{
+public:
+    explicit key_arena(std::size_t chunk_size = 64 * 1024) :
+        _current(nullptr),
+        _available(0),
+        _chunk_size(chunk_size),
+        _used(0),
+        _reserved(0)
+    {
+
+    }
+
+    key_arena(const key_arena&) = delete;
+    key_arena& operator=(const key_arena&) = delete;
+
+    key_arena(key_arena&& other) : key_arena(other._chunk_size)
+    {
+        swap(other);
+    }
+
+    key_arena& operator=(key_arena&& other)
+    {
+        key_arena temp(std::move(other));
+        swap(temp);
+        return *this;
+    }
+
+    // Copies the bytes into the arena, returns pointer to the copy. Large keys
+    // get their own chunk, so the rest of the current chunk is not wasted.
+    const char* store(const char* data, std::size_t size)
+    {
+        if (size > _available)
+        {
+            if (size > _chunk_size / 4)
+            {
+                char* chunk = _allocate_chunk(size);
+                std::memcpy(chunk, data, size);
+                _used += size;
+                return chunk;
+            }
+
+            reserve(size);
+        }
+
+        char* result = _current;
+        if (size > 0)
+        {
+            std::memcpy(result, data, size);
+        }
+
+        _current += size;
+        _available -= size;
+        _used += size;
+        return result;
+    }
+
+    // Ensures, that the keys of total size can be stored without allocation
+    void reserve(std::size_t size)
+    {
+        if (size > _available)
+        {
+            _current = _allocate_chunk(std::max(size, _chunk_size));
+            _available = std::max(size, _chunk_size);
+        }
+    }
+
+    // Releases all chunks at once
+    void clear()
+    {
+        _chunks.clear();
+        _current = nullptr;
+        _available = 0;
+        _used = 0;
+        _reserved = 0;
+    }
+
+    void swap(key_arena& other)
+    {
+        std::swap(_chunks, other._chunks);
+        std::swap(_current, other._current);
+        std::swap(_available, other._available);
+        std::swap(_chunk_size, other._chunk_size);
+        std::swap(_used, other._used);
+        std::swap(_reserved, other._reserved);
+    }
+
+    // Count of the stored bytes and count of the allocated bytes
+    std::size_t used() const { return _used; }
+    std::size_t reserved() const { return _reserved; }
+    std::size_t chunk_size() const { return _chunk_size; }
+
+private:
+    char* _allocate_chunk(std::size_t size)
+    {
+        _chunks.emplace_back(new char[size]);
+        _reserved += size;
+        return _chunks.back().get();
+    }
+
+    std::vector<std::unique_ptr<char[]>> _chunks;
+    char* _current;
+    std::size_t _available;
+    std::size_t _chunk_size;
+    std::size_t _used;
+    std::size_t _reserved;
+};
+
+template<typename T, typename Policy, typename Allocator>
+class arena_splay_map;
+
+// Handle of the key stored in the key arena. Pointer to the data is mutable,
+// because the arena map moves the keys during the compaction (the key
+// itself is not changed, so the order of the keys is kept).
+class arena_key
+{
+public:
+    arena_key() : _data(nullptr), _size(0) { }
+    explicit arena_key(const char* data, std::size_t size) : _data(data), _size(size) { }
+
+    const char* data() const { return _data; }
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    std::string str() const { return std::string(_data, _size); }
+
+#ifdef BUSHY_HAS_STRING_VIEW
+    operator std::string_view() const { return std::string_view(_data, _size); }
+#endif
+
+private:
+    template<typename, typename, typename>
+    friend class arena_splay_map;
+
+    mutable const char* _data;
+    std::size_t _size;
+};
+
+namespace impl
+{
+
+// Returns the bytes of the key, which can be compared with the arena keys
+inline std::pair<const char*, std::size_t> key_bytes(const arena_key& key) { return std::make_pair(key.data(), key.size()); }
+inline std::pair<const char*, std::size_t> key_bytes(const std::string& key) { return std::make_pair(key.data(), key.size()); }
+inline std::pair<const char*, std::size_t> key_bytes(const char* key) { return std::make_pair(key, std::strlen(key)); }
+
+#ifdef BUSHY_HAS_STRING_VIEW
+inline std::pair<const char*, std::size_t> key_bytes(std::string_view key) { return std::make_pair(key.data(), key.size()); }
+#endif
+
+// Lexicographical comparison of the bytes (as unsigned chars, as std::string does)
+inline bool key_bytes_less(std::pair<const char*, std::size_t> left, std::pair<const char*, std::size_t> right)
+{
+    const std::size_t size = std::min(left.second, right.second);
+    const int result = size > 0 ? std::memcmp(left.first, right.first, size) : 0;
+    return result < 0 || (result == 0 && left.second < right.second);
+}
+
+}   // namespace impl
+
+// Transparent comparator of the arena keys, arena keys can be compared with
+// std::string, null terminated strings and std::string_view (if available).
+struct arena_key_less
+{
+    typedef void is_transparent;
+
+    template<typename Left, typename Right>
+    bool operator()(const Left& left, const Right& right) const
+    {
+        return impl::key_bytes_less(impl::key_bytes(left), impl::key_bytes(right));
+    }
+};
+
+// Arena splay map - splay map with string keys, whose bytes are stored in the
+// key arena owned by the map. Node contains only the handle of the key, so insertion
+// of the long key needs one allocation (of the node) instead of two, and there is
+// no allocator overhead per key. Keys can be searched by any type supported
+// by arena_key_less without creating the arena key. Bytes of the erased keys
+// are reclaimed by compact(), clear() releases the whole arena at once.
+template<typename T,
+         typename Policy = splay_map_policy<splay_mode::FOURTH, splay_mode::THIRD>,
+         typename Allocator = std::allocator<std::pair<const arena_key, T>>>
+class arena_splay_map
+{
+public:
+    typedef splay_map<arena_key, T, arena_key_less, Allocator, Policy> map_type;
+    typedef typename map_type::key_type key_type;
+    typedef typename map_type::mapped_type mapped_type;
+    typedef typename map_type::value_type value_type;
+    typedef typename map_type::size_type size_type;
+    typedef typename map_type::key_compare key_compare;
+    typedef typename map_type::reference reference;
+    typedef typename map_type::const_reference const_reference;
+    typedef typename map_type::iterator iterator;
+    typedef typename map_type::const_iterator const_iterator;
+
+    explicit arena_splay_map(std::size_t chunk_size = 64 * 1024) : _arena(chunk_size), _garbage(0) { }
+
+    arena_splay_map(const arena_splay_map& other) : arena_splay_map(other._arena.chunk_size())
+    {
+        _arena.reserve(other._arena.used() - other._garbage);
+        for (const value_type& value : other._map)
+        {
+            _map.emplace_hint(_map.cend(), _store(value.first.data(), value.first.size()), value.second);
+        }
+    }
+
+    arena_splay_map(arena_splay_map&&) = default;
+
+    arena_splay_map& operator=(const arena_splay_map& other)
+    {
+        arena_splay_map temp(other);
+        swap(temp);
+        return *this;
+    }
+
+    arena_splay_map& operator=(arena_splay_map&&) = default;
+
+    // Underlying map and arena
+    const map_type& map() const { return _map; }
+    const key_arena& arena() const { return _arena; }
+
+    // Capacity
+    bool empty() const { return _map.empty(); }
+    size_type size() const { return _map.size(); }
+
+    // Count of the arena bytes of erased keys, which can be reclaimed by compact()
+    std::size_t garbage() const { return _garbage; }
+
+    // Iterators
+    iterator begin() { return _map.begin(); }
+    const_iterator begin() const { return _map.begin(); }
+    const_iterator cbegin() const { return _map.cbegin(); }
+
+    iterator end() { return _map.end(); }
+    const_iterator end() const { return _map.end(); }
+    const_iterator cend() const { return _map.cend(); }
+
+    // Element access
+    template<class K>
+    T& operator[](const K& key) { return try_emplace(key).first->second; }
+
+    template<class K>
+    T& at(const K& key)
+    {
+        iterator it = find(key);
+
+        if (it != end())
+        {
+            return it->second;
+        }
+        else
+        {
+            throw std::out_of_range("bushy::arena_splay_map::at() - key not found!");
+        }
+    }
+
+    template<class K>
+    const T& at(const K& key) const
+    {
+        return const_cast<arena_splay_map*>(this)->at(key);
+    }
+
+    // Modifiers
+
+    // Clears the map and releases the whole arena
+    void clear()
+    {
+        _map.clear();
+        _arena.clear();
+        _garbage = 0;
+    }
+
+    template<class K, class M>
+    std::pair<iterator, bool> insert(const std::pair<K, M>& value) { return try_emplace(value.first, value.second); }
+
+    // Inserts the key handle pointing to the caller's bytes, and only if the key
+    // was inserted, its bytes are copied into the arena (so the tree is searched once).
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+    {
+        const std::pair<const char*, std::size_t> bytes = impl::key_bytes(key);
+        std::pair<iterator, bool> result = _map.try_emplace(arena_key(bytes.first, bytes.second), std::forward<Args>(args)...);
+
+        if (result.second)
+        {
+            try
+            {
+                result.first->first._data = _arena.store(bytes.first, bytes.second);
+            }
+            catch (...)
+            {
+                _map.erase(result.first);
+                throw;
+            }
+        }
+
+        return result;
+    }
+
+    template<class K, class M>
+    std::pair<iterator, bool> insert_or_assign(const K& key, M&& obj)
+    {
+        std::pair<iterator, bool> result = try_emplace(key, std::forward<M>(obj));
+
+        if (!result.second)
+        {
+            result.first->second = std::forward<M>(obj);
+        }
+
+        return result;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        _garbage += pos->first.size();
+        return _map.erase(pos);
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(const_iterator(pos));
+    }
+
+    template<class K>
+    size_type erase(const K& key)
+    {
+        const_iterator it = _map.find(key);
+
+        if (it != _map.cend())
+        {
+            erase(it);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    void swap(arena_splay_map& other)
+    {
+        _map.swap(other._map);
+        _arena.swap(other._arena);
+        std::swap(_garbage, other._garbage);
+    }
+
+    // Moves the keys into the new arena, so the bytes of the erased keys are released.
+    // Whole new arena is reserved before the keys are moved, so it cannot fail in the
+    // middle. Order of the keys is not changed, so the tree is not changed. Erased nodes
+    // left in the tree (tombstone erase mode) are removed first, because iteration skips
+    // them and their keys would point into the released arena.
+    void compact()
+    {
+        _map.compact();
+
+        key_arena arena(_arena.chunk_size());
+        arena.reserve(_arena.used() - _garbage);
+
+        for (const value_type& value : _map)
+        {
+            value.first._data = arena.store(value.first.data(), value.first.size());
+        }
+
+        _arena.swap(arena);
+        _garbage = 0;
+    }
+
+    // Lookup
+
+    template<class K>
+    size_type count(const K& key) const { return _map.count(key); }
+
+    template<class K>
+    iterator find(const K& key) { return _map.find(key); }
+
+    template<class K>
+    const_iterator find(const K& key) const { return _map.find(key); }
+
+    template<class K>
+    iterator lower_bound(const K& key) { return _map.lower_bound(key); }
+
+    template<class K>
+    const_iterator lower_bound(const K& key) const { return _map.lower_bound(key); }
+
+    template<class K>
+    iterator upper_bound(const K& key) { return _map.upper_bound(key); }
+
+    template<class K>
+    const_iterator upper_bound(const K& key) const { return _map.upper_bound(key); }
+
+    // Memory consumption of the nodes and of the arena
+    unsigned long long memory_consumption() const { return sizeof(arena_splay_map) + _map.memory_consumption() - sizeof(map_type) + _arena.reserved(); }
+
+private:
+    arena_key _store(const char* data, std::size_t size)
+    {
+        return arena_key(_arena.store(data, size), size);
+    }
+
+    // Map of the key handles
+    map_type _map;
+
+    // Storage of the key bytes
+    key_arena _arena;
+
+    // Count of bytes of the erased keys
+    std::size_t _garbage;
+};
+
+}   // namespace bushy
+
+#endif // BUSHY_ARENA_SPLAY_MAP_H
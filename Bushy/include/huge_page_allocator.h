@@ -0,0 +1,299 @@
+//**************************** LICENSE *************************************
+//
+// Bushy - various search tree implementation library
+// Copyright (C) 2016  Jakub Melka
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//**************************************************************************
+
+#ifndef BUSHY_HUGE_PAGE_ALLOCATOR_H
+#define BUSHY_HUGE_PAGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define BUSHY_HAS_MMAP
+#endif
+
+namespace bushy
+{
+
+// Huge page arena - memory for the nodes of the large maps. Random access into
+// the large map touches many pages, and when the nodes are spread over millions
+// of 4K pages, the TLB misses dominate the search time. Arena reserves big chunks
+// of memory backed by the huge pages (explicit hugetlbfs pages, if requested and
+// available, otherwise transparent huge pages using MADV_HUGEPAGE, otherwise
+// ordinary memory) and carves the nodes from them sequentially. Deallocated blocks
+// are kept in the free lists of their size and they are reused by the next
+// allocations of the same size. Memory is returned to the system, when the arena
+// is destroyed, so the arena must outlive all maps using it.
+//
+// NOTE: Arena is not thread safe (as std::pmr::monotonic_buffer_resource).
+class huge_page_arena
+{
+public:
+    static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+    static constexpr std::size_t default_chunk_size = 32 * huge_page_size;
+
+    // Creates the arena. Memory is reserved in chunks of chunk_size bytes (rounded up
+    // to the huge page size), when the arena needs it. If use_hugetlb is true, explicit
+    // huge pages are tried first (they must be reserved by the system administrator).
+    explicit huge_page_arena(std::size_t chunk_size = default_chunk_size, bool use_hugetlb = false) :
+        _chunk_size((chunk_size + huge_page_size - 1) / huge_page_size * huge_page_size),
+        _use_hugetlb(use_hugetlb),
+        _huge_pages(false),
+        _current(nullptr),
+        _end(nullptr),
+        _free()
+    {
+
+    }
+
+    ~huge_page_arena()
+    {
+        for (const chunk& item : _chunks)
+        {
+            _release_chunk(item);
+        }
+    }
+
+    huge_page_arena(const huge_page_arena&) = delete;
+    huge_page_arena& operator=(const huge_page_arena&) = delete;
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        const std::size_t size = _round_size(bytes);
+        const std::size_t size_class = size / granularity;
+
+        if (size_class < free_list_count && _free[size_class] && reinterpret_cast<std::uintptr_t>(_free[size_class]) % alignment == 0)
+        {
+            // Reuse the deallocated block (if it has the required alignment)
+            free_block* block = _free[size_class];
+            _free[size_class] = block->next;
+            return block;
+        }
+
+        char* result = _align(_current, alignment);
+        if (!_current || result + size > _end)
+        {
+            _add_chunk(size + alignment);
+            result = _align(_current, alignment);
+        }
+
+        _current = result + size;
+        return result;
+    }
+
+    void deallocate(void* pointer, std::size_t bytes)
+    {
+        const std::size_t size_class = _round_size(bytes) / granularity;
+
+        // Large blocks are not reused, they are released with the arena
+        if (size_class < free_list_count)
+        {
+            free_block* block = static_cast<free_block*>(pointer);
+            block->next = _free[size_class];
+            _free[size_class] = block;
+        }
+    }
+
+    // Returns count of the bytes reserved from the system
+    std::size_t reserved() const
+    {
+        std::size_t result = 0;
+        for (const chunk& item : _chunks)
+        {
+            result += item.size;
+        }
+        return result;
+    }
+
+    // Returns true, if at least one chunk was advised (or allocated) as huge pages
+    bool huge_pages() const { return _huge_pages; }
+
+private:
+    static constexpr std::size_t granularity = alignof(void*);
+    static constexpr std::size_t free_list_count = 64;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    struct chunk
+    {
+        void* memory;
+        std::size_t size;
+        bool mapped;
+    };
+
+    static std::size_t _round_size(std::size_t bytes)
+    {
+        const std::size_t size = bytes < sizeof(free_block) ? sizeof(free_block) : bytes;
+        return (size + granularity - 1) / granularity * granularity;
+    }
+
+    static char* _align(char* pointer, std::size_t alignment)
+    {
+        const std::uintptr_t value = reinterpret_cast<std::uintptr_t>(pointer);
+        return pointer + ((alignment - value % alignment) % alignment);
+    }
+
+    // Reserves new chunk, which has at least minimal_size bytes
+    void _add_chunk(std::size_t minimal_size)
+    {
+        std::size_t size = _chunk_size;
+        if (size < minimal_size)
+        {
+            size = (minimal_size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        }
+
+        chunk item = { nullptr, size, false };
+
+#ifdef BUSHY_HAS_MMAP
+#ifdef MAP_HUGETLB
+        if (_use_hugetlb)
+        {
+            void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED)
+            {
+                item.memory = memory;
+                item.mapped = true;
+                _huge_pages = true;
+            }
+        }
+#endif
+
+        if (!item.memory)
+        {
+            // Map more memory, so the chunk can be aligned to the huge page size,
+            // and then unmap the unaligned head and tail.
+            const std::size_t mapped_size = size + huge_page_size;
+            void* memory = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory != MAP_FAILED)
+            {
+                char* begin = static_cast<char*>(memory);
+                char* aligned = _align(begin, huge_page_size);
+                char* end = begin + mapped_size;
+
+                if (aligned != begin)
+                {
+                    ::munmap(begin, aligned - begin);
+                }
+                if (aligned + size != end)
+                {
+                    ::munmap(aligned + size, end - (aligned + size));
+                }
+
+                item.memory = aligned;
+                item.mapped = true;
+
+#ifdef MADV_HUGEPAGE
+                if (::madvise(aligned, size, MADV_HUGEPAGE) == 0)
+                {
+                    _huge_pages = true;
+                }
+#endif
+            }
+        }
+#endif
+
+        if (!item.memory)
+        {
+            item.memory = ::operator new(size);
+        }
+
+        try
+        {
+            _chunks.push_back(item);
+        }
+        catch (...)
+        {
+            _release_chunk(item);
+            throw;
+        }
+
+        _current = static_cast<char*>(item.memory);
+        _end = _current + size;
+    }
+
+    static void _release_chunk(const chunk& item)
+    {
+#ifdef BUSHY_HAS_MMAP
+        if (item.mapped)
+        {
+            ::munmap(item.memory, item.size);
+            return;
+        }
+#endif
+        ::operator delete(item.memory);
+    }
+
+    // Size of the newly reserved chunks
+    std::size_t _chunk_size;
+
+    // Try the explicit huge pages (hugetlbfs) first
+    bool _use_hugetlb;
+
+    // Some chunk uses huge pages
+    bool _huge_pages;
+
+    // Free part of the last chunk
+    char* _current;
+    char* _end;
+
+    // Free lists of the deallocated blocks, indexed by size / granularity
+    free_block* _free[free_list_count];
+
+    // Reserved chunks
+    std::vector<chunk> _chunks;
+};
+
+// Allocator using the huge page arena. Allocators are equal, if they use
+// the same arena. Allocator is not propagated on container copy/move
+// assignment or swap (as std::pmr::polymorphic_allocator).
+template<typename T>
+class huge_page_allocator
+{
+public:
+    typedef T value_type;
+
+    huge_page_allocator(huge_page_arena* arena) noexcept : _arena(arena) { }
+
+    template<typename U>
+    huge_page_allocator(const huge_page_allocator<U>& other) noexcept : _arena(other.arena()) { }
+
+    T* allocate(std::size_t count) { return static_cast<T*>(_arena->allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T* pointer, std::size_t count) { _arena->deallocate(pointer, count * sizeof(T)); }
+
+    huge_page_arena* arena() const { return _arena; }
+
+private:
+    huge_page_arena* _arena;
+};
+
+template<typename T, typename U>
+bool operator==(const huge_page_allocator<T>& l, const huge_page_allocator<U>& r) { return l.arena() == r.arena(); }
+
+template<typename T, typename U>
+bool operator!=(const huge_page_allocator<T>& l, const huge_page_allocator<U>& r) { return l.arena() != r.arena(); }
+
+}   // namespace bushy
+
+#endif // BUSHY_HUGE_PAGE_ALLOCATOR_H
@@ -0,0 +1,877 @@
+//**************************** LICENSE *************************************
+//
+// Bushy - various search tree implementation library
+// Copyright (C) 2016  Jakub Melka
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//**************************************************************************
+
+#ifndef BUSHY_PREFIX_SPLAY_MAP_H
+#define BUSHY_PREFIX_SPLAY_MAP_H
+
+#include "splay_map.h"
+
+#include <string>
+
+namespace bushy
+{
+
+// Prefix splay map - ordered map with string keys, which stores the keys
+// prefix-compressed. Entries are kept in small sorted buckets, each key in
+// the bucket is front-coded against the previous key (length of the shared
+// prefix, length of the rest and the rest of the key), the first key against
+// the separator of the bucket. Buckets are stored in the splay map keyed by
+// the separators, so frequently used buckets stay near the root. Search in
+// the bucket never compares the shared prefixes again, and most of the keys
+// are skipped without any comparison.
+//
+// NOTE: Each insertion or erase invalidates the iterators and references to
+// the values (values are moved inside the buckets). The key is decoded into
+// the iterator, so reference to the key is valid only as long as the iterator
+// itself. Decrement of the iterator decodes the bucket from its beginning,
+// so it is slower than the increment.
+template<typename T,
+         typename Policy = splay_map_policy<splay_mode::FOURTH, splay_mode::THIRD>,
+         std::size_t BucketCapacity = 32>
+class prefix_splay_map
+{
+    static_assert(BucketCapacity >= 4, "Bucket capacity must be at least 4!");
+
+private:
+    // Bucket of the entries, keys are front-coded in the data
+    struct bucket
+    {
+        std::string data;
+        std::vector<T> values;
+    };
+
+    typedef splay_map<std::string, bucket, std::less<std::string>, std::allocator<std::pair<const std::string, bucket>>, Policy> bucket_map;
+
+public:
+    typedef std::string key_type;
+    typedef T mapped_type;
+    typedef std::pair<const std::string, T> value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::less<std::string> key_compare;
+    typedef std::pair<const std::string&, T&> reference;
+    typedef std::pair<const std::string&, const T&> const_reference;
+
+    // Iterator implementation, Const selects the constant iterator. Dereference
+    // returns pair of references to the key (stored in the iterator) and to
+    // the value (stored in the bucket).
+    template<bool Const>
+    class iterator_impl
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef typename prefix_splay_map::value_type value_type;
+        typedef typename prefix_splay_map::difference_type difference_type;
+        typedef typename std::conditional<Const, const_reference, typename prefix_splay_map::reference>::type reference;
+
+        // Pointer returned by the arrow operator, holds the pair of references
+        class pointer
+        {
+        public:
+            explicit pointer(reference value) : _value(value) { }
+            reference* operator->() { return &_value; }
+
+        private:
+            reference _value;
+        };
+
+        iterator_impl() : _index(0), _offset(0), _proxy(nullptr) { }
+
+        // Conversion constructor from iterator to const iterator
+        template<bool ConstFrom>
+        iterator_impl(const iterator_impl<ConstFrom>& other, typename std::enable_if<Const || !ConstFrom, int>::type = int()) :
+            _bucket(other._bucket),
+            _index(other._index),
+            _offset(other._offset),
+            _key(other._key),
+            _proxy(other._proxy)
+        {
+
+        }
+
+        // Dereference operators
+        reference operator*() const { return reference(_key, _bucket->second.values[_index]); }
+        pointer operator->() const { return pointer(**this); }
+
+        // Key of the current entry
+        const std::string& key() const { return _key; }
+
+        iterator_impl& operator++()
+        {
+            const bucket& current = _bucket->second;
+            _offset = _skip(current.data, _offset);
+
+            if (++_index == current.values.size())
+            {
+                _load(std::next(_bucket), 0);
+            }
+            else
+            {
+                _decode(current.data, _offset, _key);
+            }
+
+            return *this;
+        }
+
+        iterator_impl operator++(int)
+        {
+            iterator_impl temp(*this);
+            ++*this;
+            return temp;
+        }
+
+        iterator_impl& operator--()
+        {
+            if (_index > 0)
+            {
+                _load(_bucket, _index - 1);
+            }
+            else
+            {
+                bucket_iterator previous = std::prev(_bucket);
+                _load(previous, previous->second.values.size() - 1);
+            }
+
+            return *this;
+        }
+
+        iterator_impl operator--(int)
+        {
+            iterator_impl temp(*this);
+            --*this;
+            return temp;
+        }
+
+        template<bool OtherConst>
+        bool operator==(const iterator_impl<OtherConst>& other) const
+        {
+            return _bucket == other._bucket && _index == other._index;
+        }
+
+        template<bool OtherConst>
+        bool operator!=(const iterator_impl<OtherConst>& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        typedef typename std::conditional<Const, typename bucket_map::const_iterator, typename bucket_map::iterator>::type bucket_iterator;
+
+        explicit iterator_impl(const prefix_splay_map* proxy) : _index(0), _offset(0), _proxy(proxy) { }
+
+        // Positions the iterator to the entry with given index in the bucket,
+        // bucket can be the end bucket, then the iterator is end iterator.
+        void _load(bucket_iterator bucket_it, size_type index)
+        {
+            _bucket = bucket_it;
+            _index = index;
+            _offset = 0;
+
+            if (_bucket == _proxy->_buckets.cend())
+            {
+                _index = 0;
+                _key.clear();
+                return;
+            }
+
+            const std::string& data = _bucket->second.data;
+            _key = _bucket->first;
+
+            size_type next = _decode(data, 0, _key);
+            for (size_type i = 0; i < index; ++i)
+            {
+                _offset = next;
+                next = _decode(data, next, _key);
+            }
+        }
+
+        // To allow use of private members in the map and in the other iterator type
+        friend class prefix_splay_map;
+        template<bool> friend class iterator_impl;
+
+        bucket_iterator _bucket;
+        size_type _index;
+        size_type _offset;
+        std::string _key;
+        const prefix_splay_map* _proxy;
+    };
+
+    using iterator = iterator_impl<false>;
+    using const_iterator = iterator_impl<true>;
+
+    // Constructors
+
+    prefix_splay_map() : _size(0) { }
+
+    template<class InputIterator>
+    prefix_splay_map(InputIterator first, InputIterator last) : prefix_splay_map()
+    {
+        insert(first, last);
+    }
+
+    prefix_splay_map(std::initializer_list<value_type> ilist) : prefix_splay_map(ilist.begin(), ilist.end()) { }
+
+    prefix_splay_map(const prefix_splay_map&) = default;
+
+    prefix_splay_map(prefix_splay_map&& other) :
+        _buckets(std::move(other._buckets)),
+        _size(other._size)
+    {
+        other._size = 0;
+    }
+
+    prefix_splay_map& operator=(const prefix_splay_map&) = default;
+
+    prefix_splay_map& operator=(prefix_splay_map&& other)
+    {
+        _buckets = std::move(other._buckets);
+        _size = other._size;
+        other._size = 0;
+        return *this;
+    }
+
+    // Element access
+
+    T& at(const std::string& key)
+    {
+        iterator it = find(key);
+
+        if (it != end())
+        {
+            return it->second;
+        }
+        else
+        {
+            throw std::out_of_range("bushy::prefix_splay_map::at() - key not found!");
+        }
+    }
+
+    const T& at(const std::string& key) const
+    {
+        return const_cast<prefix_splay_map*>(this)->at(key);
+    }
+
+    T& operator[](const std::string& key)
+    {
+        return try_emplace(key).first->second;
+    }
+
+    // Iterators
+
+    iterator begin() { return _iterator_at(_buckets.begin(), 0); }
+    const_iterator begin() const { return const_cast<prefix_splay_map*>(this)->begin(); }
+    const_iterator cbegin() const { return begin(); }
+
+    iterator end() { return _iterator_at(_buckets.end(), 0); }
+    const_iterator end() const { return const_cast<prefix_splay_map*>(this)->end(); }
+    const_iterator cend() const { return end(); }
+
+    // Capacity
+
+    bool empty() const { return _size == 0; }
+    size_type size() const { return _size; }
+    size_type max_size() const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+    // Modifiers
+
+    void clear()
+    {
+        _buckets.clear();
+        _size = 0;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return try_emplace(value.first, value.second); }
+    std::pair<iterator, bool> insert(value_type&& value) { return try_emplace(value.first, std::move(value.second)); }
+
+    template<class InputIt>
+    void insert(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+        {
+            insert(*first);
+        }
+    }
+
+    void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(const std::string& key, M&& obj)
+    {
+        std::pair<iterator, bool> result = try_emplace(key, std::forward<M>(obj));
+
+        if (!result.second)
+        {
+            result.first->second = std::forward<M>(obj);
+        }
+
+        return result;
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        value_type value(std::forward<Args>(args)...);
+        return try_emplace(value.first, std::move(value.second));
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const std::string& key, Args&&... args)
+    {
+        if (_buckets.empty())
+        {
+            bucket new_bucket;
+            _encode(new_bucket.data, key, key);
+            new_bucket.values.emplace_back(std::forward<Args>(args)...);
+
+            typename bucket_map::iterator bucket_it = _buckets.emplace(key, std::move(new_bucket)).first;
+            ++_size;
+            return std::make_pair(_iterator_at(bucket_it, 0), true);
+        }
+
+        typename bucket_map::iterator bucket_it = _locate(key);
+        if (bucket_it == _buckets.end())
+        {
+            // Key is less than all keys in the map, lower the separator of the first bucket
+            bucket_it = _lower_separator(key);
+        }
+
+        std::string prev;
+        position pos = _scan(bucket_it, key, &prev);
+        if (pos.equal)
+        {
+            return std::make_pair(_iterator_at(bucket_it, pos.index, pos.offset, key), false);
+        }
+
+        // Encode the new entry and the following entry (it is now encoded against the new key)
+        bucket& current = bucket_it->second;
+        std::string encoded;
+        _encode(encoded, prev, key);
+
+        size_type end = pos.offset;
+        if (end < current.data.size())
+        {
+            std::string next = std::move(prev);
+            end = _decode(current.data, pos.offset, next);
+            _encode(encoded, key, next);
+        }
+
+        current.values.emplace(current.values.begin() + pos.index, std::forward<Args>(args)...);
+        try
+        {
+            current.data.replace(pos.offset, end - pos.offset, encoded);
+        }
+        catch (...)
+        {
+            current.values.erase(current.values.begin() + pos.index);
+            throw;
+        }
+
+        ++_size;
+
+        if (current.values.size() <= BucketCapacity)
+        {
+            return std::make_pair(_iterator_at(bucket_it, pos.index, pos.offset, key), true);
+        }
+
+        typename bucket_map::iterator new_bucket_it = _split(bucket_it);
+        if (!(key < new_bucket_it->first))
+        {
+            bucket_it = new_bucket_it;
+        }
+
+        pos = _scan(bucket_it, key, nullptr);
+        return std::make_pair(_iterator_at(bucket_it, pos.index, pos.offset, key), true);
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        typename bucket_map::iterator bucket_it = _buckets.find(pos._bucket->first);
+        return _erase(bucket_it, pos._index, pos._offset, pos._key);
+    }
+
+    iterator erase(iterator pos)
+    {
+        return _erase(pos._bucket, pos._index, pos._offset, pos._key);
+    }
+
+    size_type erase(const std::string& key)
+    {
+        typename bucket_map::iterator bucket_it = _locate(key);
+        if (bucket_it == _buckets.end())
+        {
+            return 0;
+        }
+
+        const position pos = _scan(bucket_it, key, nullptr);
+        if (!pos.equal)
+        {
+            return 0;
+        }
+
+        _erase(bucket_it, pos.index, pos.offset, key);
+        return 1;
+    }
+
+    void swap(prefix_splay_map& other)
+    {
+        _buckets.swap(other._buckets);
+        std::swap(_size, other._size);
+    }
+
+    // Lookup
+
+    size_type count(const std::string& key) const { return find(key) != end() ? 1 : 0; }
+
+    iterator find(const std::string& key)
+    {
+        typename bucket_map::iterator bucket_it = _locate(key);
+        if (bucket_it != _buckets.end())
+        {
+            const position pos = _scan(bucket_it, key, nullptr);
+            if (pos.equal)
+            {
+                return _iterator_at(bucket_it, pos.index, pos.offset, key);
+            }
+        }
+
+        return end();
+    }
+
+    const_iterator find(const std::string& key) const { return const_cast<prefix_splay_map*>(this)->find(key); }
+
+    iterator lower_bound(const std::string& key)
+    {
+        typename bucket_map::iterator bucket_it = _locate(key);
+        if (bucket_it == _buckets.end())
+        {
+            // Key is less than all keys in the map (or the map is empty)
+            return begin();
+        }
+
+        std::string found;
+        const position pos = _scan(bucket_it, key, &found);
+        if (pos.index == bucket_it->second.values.size())
+        {
+            return _iterator_at(std::next(bucket_it), 0);
+        }
+
+        _decode(bucket_it->second.data, pos.offset, found);
+        return _iterator_at(bucket_it, pos.index, pos.offset, std::move(found));
+    }
+
+    const_iterator lower_bound(const std::string& key) const { return const_cast<prefix_splay_map*>(this)->lower_bound(key); }
+
+    iterator upper_bound(const std::string& key)
+    {
+        iterator it = lower_bound(key);
+
+        if (it != end() && it._key == key)
+        {
+            ++it;
+        }
+
+        return it;
+    }
+
+    const_iterator upper_bound(const std::string& key) const { return const_cast<prefix_splay_map*>(this)->upper_bound(key); }
+
+    std::pair<iterator, iterator> equal_range(const std::string& key)
+    {
+        iterator first = lower_bound(key);
+        iterator last = first;
+
+        if (last != end() && last._key == key)
+        {
+            ++last;
+        }
+
+        return std::make_pair(first, last);
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const std::string& key) const
+    {
+        std::pair<iterator, iterator> result = const_cast<prefix_splay_map*>(this)->equal_range(key);
+        return std::make_pair(const_iterator(result.first), const_iterator(result.second));
+    }
+
+    // Visitation - calls the visitor with pair of references to the key and to the value
+    // for each entry in the key order. The visitor can stop the visitation by returning
+    // false. Returns true, if all entries were visited.
+
+    template<class Visitor>
+    bool for_each(Visitor visitor) { return _for_each<reference>(visitor); }
+
+    template<class Visitor>
+    bool for_each(Visitor visitor) const { return const_cast<prefix_splay_map*>(this)->template _for_each<const_reference>(visitor); }
+
+    // Memory consumption - approximate count of bytes used by the map,
+    // including the encoded keys and the values. It walks all buckets.
+    unsigned long long memory_consumption() const
+    {
+        unsigned long long result = sizeof(prefix_splay_map) - sizeof(bucket_map) + _buckets.memory_consumption();
+
+        for (const auto& item : _buckets)
+        {
+            result += item.first.capacity() + item.second.data.capacity() + item.second.values.capacity() * sizeof(T);
+        }
+
+        return result;
+    }
+
+private:
+    // Position of the key in the bucket - index and offset of the first entry
+    // not less than the key and flag, if the entry is equal to the key.
+    struct position
+    {
+        size_type index;
+        size_type offset;
+        bool equal;
+    };
+
+    // Returns length of the common prefix of the two strings
+    static size_type _common_prefix(const char* left, size_type left_size, const char* right, size_type right_size)
+    {
+        const size_type size = std::min(left_size, right_size);
+
+        size_type i = 0;
+        while (i < size && left[i] == right[i])
+        {
+            ++i;
+        }
+
+        return i;
+    }
+
+    // Appends the length encoded by 7 bits in byte (high bit marks continuation)
+    static void _put_length(std::string& data, size_type length)
+    {
+        while (length >= 0x80)
+        {
+            data.push_back(static_cast<char>((length & 0x7F) | 0x80));
+            length >>= 7;
+        }
+
+        data.push_back(static_cast<char>(length));
+    }
+
+    // Reads the length encoded by _put_length, and moves the offset after it
+    static size_type _get_length(const std::string& data, size_type& offset)
+    {
+        size_type length = 0;
+        unsigned int shift = 0;
+        unsigned char byte = 0;
+
+        do
+        {
+            byte = static_cast<unsigned char>(data[offset++]);
+            length |= static_cast<size_type>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        return length;
+    }
+
+    // Appends the entry of the key front-coded against the previous key
+    static void _encode(std::string& data, const std::string& prev, const std::string& key)
+    {
+        const size_type shared = _common_prefix(prev.data(), prev.size(), key.data(), key.size());
+        _put_length(data, shared);
+        _put_length(data, key.size() - shared);
+        data.append(key, shared, std::string::npos);
+    }
+
+    // Decodes the entry at the offset. Key must contain the previous key, and
+    // it is replaced by the key of the entry. Returns offset of the next entry.
+    static size_type _decode(const std::string& data, size_type offset, std::string& key)
+    {
+        const size_type shared = _get_length(data, offset);
+        const size_type length = _get_length(data, offset);
+        key.resize(shared);
+        key.append(data, offset, length);
+        return offset + length;
+    }
+
+    // Returns offset of the next entry without decoding the key
+    static size_type _skip(const std::string& data, size_type offset)
+    {
+        _get_length(data, offset);
+        const size_type length = _get_length(data, offset);
+        return offset + length;
+    }
+
+    // Creates the iterator to the entry with given index in the bucket
+    iterator _iterator_at(typename bucket_map::iterator bucket_it, size_type index)
+    {
+        iterator result(this);
+        result._load(bucket_it, index);
+        return result;
+    }
+
+    // Creates the iterator to the entry, whose position and key is known
+    iterator _iterator_at(typename bucket_map::iterator bucket_it, size_type index, size_type offset, std::string key)
+    {
+        iterator result(this);
+        result._bucket = bucket_it;
+        result._index = index;
+        result._offset = offset;
+        result._key = std::move(key);
+        return result;
+    }
+
+    // Finds the bucket with the greatest separator not greater than the key,
+    // if the key is less than all separators, end is returned.
+    typename bucket_map::iterator _locate(const std::string& key)
+    {
+        typename bucket_map::iterator bucket_it = _buckets.upper_bound(key);
+
+        if (bucket_it == _buckets.begin())
+        {
+            return _buckets.end();
+        }
+
+        return --bucket_it;
+    }
+
+    // Finds the position of the key in the bucket. Separator of the bucket must not be
+    // greater than the key. Previous key is never greater than the key, so the entry
+    // sharing longer prefix with it than the key is less than the key, and the entry
+    // sharing shorter prefix is greater than the key. Only entries sharing the same
+    // prefix are compared, and only after the shared prefix. If prev is not null,
+    // key of the previous entry (separator for the first entry) is decoded into it.
+    position _scan(typename bucket_map::iterator bucket_it, const std::string& key, std::string* prev) const
+    {
+        const std::string& separator = bucket_it->first;
+        const std::string& data = bucket_it->second.data;
+
+        position result;
+        result.index = 0;
+        result.offset = 0;
+        result.equal = false;
+
+        if (prev)
+        {
+            *prev = separator;
+        }
+
+        size_type match = _common_prefix(separator.data(), separator.size(), key.data(), key.size());
+        while (result.offset < data.size())
+        {
+            size_type offset = result.offset;
+            const size_type shared = _get_length(data, offset);
+            const size_type length = _get_length(data, offset);
+
+            if (shared < match)
+            {
+                // Entry differs from the key earlier than the previous key and it is greater
+                break;
+            }
+
+            if (shared == match)
+            {
+                const size_type common = _common_prefix(data.data() + offset, length, key.data() + match, key.size() - match);
+                const bool key_end = match + common == key.size();
+
+                if (common == length && key_end)
+                {
+                    result.equal = true;
+                    break;
+                }
+
+                if (key_end || (common < length && static_cast<unsigned char>(data[offset + common]) > static_cast<unsigned char>(key[match + common])))
+                {
+                    // Key is the prefix of the entry, or the entry is greater
+                    break;
+                }
+
+                match += common;
+            }
+
+            if (prev)
+            {
+                prev->resize(shared);
+                prev->append(data, offset, length);
+            }
+
+            result.offset = offset + length;
+            ++result.index;
+        }
+
+        return result;
+    }
+
+    // Replaces the separator of the first bucket by the key, which is less than it
+    typename bucket_map::iterator _lower_separator(const std::string& key)
+    {
+        typename bucket_map::iterator first = _buckets.begin();
+        bucket moved = std::move(first->second);
+
+        std::string first_key = first->first;
+        const size_type end = _decode(moved.data, 0, first_key);
+
+        std::string encoded;
+        _encode(encoded, key, first_key);
+        moved.data.replace(0, end, encoded);
+
+        _buckets.erase(first);
+        return _buckets.emplace_hint(_buckets.cbegin(), key, std::move(moved));
+    }
+
+    // Splits the bucket in the middle, returns the new bucket
+    typename bucket_map::iterator _split(typename bucket_map::iterator bucket_it)
+    {
+        bucket& current = bucket_it->second;
+        const size_type middle = current.values.size() / 2;
+
+        // Decode the keys up to the middle entry, which becomes the new separator
+        std::string separator = bucket_it->first;
+        size_type offset = 0;
+        for (size_type i = 0; i < middle; ++i)
+        {
+            offset = _decode(current.data, offset, separator);
+        }
+        const size_type end = _decode(current.data, offset, separator);
+
+        bucket new_bucket;
+        _encode(new_bucket.data, separator, separator);
+        new_bucket.data.append(current.data, end, std::string::npos);
+        new_bucket.values.assign(std::make_move_iterator(current.values.begin() + middle), std::make_move_iterator(current.values.end()));
+
+        current.data.resize(offset);
+        current.values.erase(current.values.begin() + middle, current.values.end());
+
+        return _buckets.emplace_hint(std::next(bucket_it), std::move(separator), std::move(new_bucket));
+    }
+
+    // Appends the entries of the next bucket to the bucket and removes the next bucket
+    void _merge(typename bucket_map::iterator bucket_it, typename bucket_map::iterator next_it)
+    {
+        bucket& current = bucket_it->second;
+        bucket& next = next_it->second;
+
+        std::string last = bucket_it->first;
+        for (size_type offset = 0; offset < current.data.size();)
+        {
+            offset = _decode(current.data, offset, last);
+        }
+
+        std::string first = next_it->first;
+        const size_type end = _decode(next.data, 0, first);
+
+        std::string data = current.data;
+        _encode(data, last, first);
+        data.append(next.data, end, std::string::npos);
+
+        current.values.insert(current.values.end(), std::make_move_iterator(next.values.begin()), std::make_move_iterator(next.values.end()));
+        current.data.swap(data);
+
+        _buckets.erase(next_it);
+    }
+
+    // Erases the entry with given key at the position. The following entry is re-encoded
+    // against the previous entry, it shares min(shared, next shared) characters with it.
+    // Small bucket is merged with the next bucket. Returns iterator to the following entry.
+    iterator _erase(typename bucket_map::iterator bucket_it, size_type index, size_type offset, const std::string& key)
+    {
+        bucket& current = bucket_it->second;
+
+        size_type cursor = offset;
+        const size_type shared = _get_length(current.data, cursor);
+        const size_type length = _get_length(current.data, cursor);
+        const size_type end = cursor + length;
+
+        if (end < current.data.size())
+        {
+            cursor = end;
+            const size_type next_shared = _get_length(current.data, cursor);
+            const size_type next_length = _get_length(current.data, cursor);
+            const size_type common = std::min(shared, next_shared);
+
+            std::string encoded;
+            _put_length(encoded, common);
+            _put_length(encoded, next_shared - common + next_length);
+            encoded.append(key, common, next_shared - common);
+            encoded.append(current.data, cursor, next_length);
+            current.data.replace(offset, cursor + next_length - offset, encoded);
+        }
+        else
+        {
+            current.data.resize(offset);
+        }
+
+        current.values.erase(current.values.begin() + index);
+        --_size;
+
+        if (current.values.empty())
+        {
+            return _iterator_at(_buckets.erase(bucket_it), 0);
+        }
+
+        typename bucket_map::iterator next_it = std::next(bucket_it);
+        if (current.values.size() < BucketCapacity / 4 && next_it != _buckets.end() && current.values.size() + next_it->second.values.size() <= BucketCapacity)
+        {
+            _merge(bucket_it, next_it);
+        }
+
+        if (index == current.values.size())
+        {
+            return _iterator_at(std::next(bucket_it), 0);
+        }
+
+        std::string next = key;
+        _decode(current.data, offset, next);
+        return _iterator_at(bucket_it, index, offset, std::move(next));
+    }
+
+    // Visits all entries in the key order
+    template<typename Reference, typename Visitor>
+    bool _for_each(Visitor& visitor)
+    {
+        std::string key;
+        for (auto& item : _buckets)
+        {
+            const std::string& data = item.second.data;
+            key = item.first;
+
+            size_type offset = 0;
+            for (T& value : item.second.values)
+            {
+                offset = _decode(data, offset, key);
+
+                Reference entry(key, value);
+                if (!impl::visit(visitor, entry))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Buckets keyed by separators
+    bucket_map _buckets;
+
+    // Count of the entries
+    size_type _size;
+};
+
+}   // namespace bushy
+
+#endif // BUSHY_PREFIX_SPLAY_MAP_H
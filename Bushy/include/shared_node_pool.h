@@ -0,0 +1,507 @@
+//**************************** LICENSE *************************************
+//
+// Bushy - various search tree implementation library
+// Copyright (C) 2016  Jakub Melka
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//**************************************************************************
+
+#ifndef BUSHY_SHARED_NODE_POOL_H
+#define BUSHY_SHARED_NODE_POOL_H
+
+#include "splay_map.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#ifndef BUSHY_HAS_MMAP
+#define BUSHY_HAS_MMAP
+#endif
+#endif
+
+namespace bushy
+{
+
+// Shared node pool - pool of the nodes for many maps (for example thousands of the
+// per-session maps). Memory is divided into slabs, each slab contains blocks of one
+// size, and it is aligned to its size, so the slab of the block is found by masking
+// of the block address. Fully empty slabs are returned to the system (one empty slab
+// per stripe is kept to avoid repeated mapping/unmapping at the slab boundary).
+//
+// The pool is lock-striped: each stripe has its own lock and slabs, thread allocates
+// from the stripe selected by its id, and block is always returned to the stripe
+// of its slab. So the pool can be used from many threads concurrently (each map
+// itself must be still used from one thread at a time). The pool must outlive all
+// maps using it.
+class shared_node_pool
+{
+public:
+    static constexpr std::size_t default_slab_size = 64 * 1024;
+    static constexpr std::size_t default_stripe_count = 8;
+
+    // Maximal supported alignment of the blocks (cache line)
+    static constexpr std::size_t max_alignment = 64;
+
+    // Creates the pool. Slab size is rounded up to the power of two.
+    explicit shared_node_pool(std::size_t slab_size = default_slab_size, std::size_t stripe_count = default_stripe_count) :
+        _slab_size(_round_slab_size(slab_size)),
+        _stripe_count(stripe_count > 0 ? stripe_count : 1),
+        _stripes(new stripe[_stripe_count]),
+        _used(0),
+        _slabs(0)
+    {
+
+    }
+
+    ~shared_node_pool()
+    {
+        for (std::size_t i = 0; i < _stripe_count; ++i)
+        {
+            stripe& current = _stripes[i];
+            for (slab* head : current.partial)
+            {
+                while (head)
+                {
+                    slab* next = head->next;
+                    _release_slab(head);
+                    head = next;
+                }
+            }
+
+            if (current.spare)
+            {
+                _release_slab(current.spare);
+            }
+        }
+    }
+
+    shared_node_pool(const shared_node_pool&) = delete;
+    shared_node_pool& operator=(const shared_node_pool&) = delete;
+
+    // Returns size of the block used for the allocation
+    static std::size_t block_size(std::size_t bytes, std::size_t alignment)
+    {
+        const std::size_t unit = alignment > granularity ? alignment : granularity;
+        const std::size_t size = bytes < sizeof(free_block) ? sizeof(free_block) : bytes;
+        return (size + unit - 1) / unit * unit;
+    }
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        const std::size_t size = block_size(bytes, alignment);
+
+        if (_is_large(size))
+        {
+            void* result = _allocate_large(size, alignment);
+            _used += size;
+            return result;
+        }
+
+        stripe& current = _stripes[std::hash<std::thread::id>()(std::this_thread::get_id()) % _stripe_count];
+        std::lock_guard<std::mutex> lock(current.mutex);
+
+        slab*& head = current.partial[size / granularity];
+        if (!head)
+        {
+            head = _new_slab(current, size);
+        }
+
+        slab* item = head;
+        void* result = nullptr;
+        if (item->free)
+        {
+            result = item->free;
+            item->free = item->free->next;
+        }
+        else
+        {
+            result = item->carve;
+            item->carve += size;
+        }
+        ++item->used;
+
+        if (_is_full(item))
+        {
+            // Full slabs are not in the list, they are returned back by deallocation
+            head = item->next;
+            if (head)
+            {
+                head->prev = nullptr;
+            }
+        }
+
+        _used += size;
+        return result;
+    }
+
+    void deallocate(void* pointer, std::size_t bytes, std::size_t alignment)
+    {
+        const std::size_t size = block_size(bytes, alignment);
+        _used -= size;
+
+        if (_is_large(size))
+        {
+            _deallocate_large(pointer, alignment);
+            return;
+        }
+
+        slab* item = reinterpret_cast<slab*>(reinterpret_cast<std::uintptr_t>(pointer) & ~static_cast<std::uintptr_t>(_slab_size - 1));
+        stripe& owner = *item->owner;
+        std::lock_guard<std::mutex> lock(owner.mutex);
+
+        const bool was_full = _is_full(item);
+        free_block* block = static_cast<free_block*>(pointer);
+        block->next = item->free;
+        item->free = block;
+        --item->used;
+
+        slab*& head = owner.partial[size / granularity];
+        if (item->used == 0)
+        {
+            // Slab is empty, keep it as spare, or return it to the system
+            if (!was_full)
+            {
+                _unlink(head, item);
+            }
+
+            if (!owner.spare)
+            {
+                owner.spare = item;
+            }
+            else
+            {
+                _release_slab(item);
+            }
+        }
+        else if (was_full)
+        {
+            item->prev = nullptr;
+            item->next = head;
+            if (head)
+            {
+                head->prev = item;
+            }
+            head = item;
+        }
+    }
+
+    // Returns count of the bytes in the allocated blocks (all maps)
+    std::size_t used() const { return _used.load(std::memory_order_relaxed); }
+
+    // Returns count of the bytes reserved from the system for the slabs
+    std::size_t reserved() const { return slab_count() * _slab_size; }
+
+    // Returns count of the slabs
+    std::size_t slab_count() const { return _slabs.load(std::memory_order_relaxed); }
+
+    std::size_t slab_size() const { return _slab_size; }
+
+private:
+    static constexpr std::size_t granularity = alignof(void*);
+    static constexpr std::size_t class_count = 64;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    struct stripe;
+
+    // Header of the slab, it is placed at the beginning of the slab memory
+    struct slab
+    {
+        slab* prev;
+        slab* next;
+        free_block* free;
+        char* carve;
+        std::size_t used;
+        std::size_t size;
+        stripe* owner;
+        void* memory;
+        bool mapped;
+    };
+
+    static constexpr std::size_t header_size = (sizeof(slab) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+    struct stripe
+    {
+        std::mutex mutex;
+
+        // Slabs with free blocks, indexed by block size / granularity
+        slab* partial[class_count] = { };
+
+        // Empty slab kept for reuse
+        slab* spare = nullptr;
+    };
+
+    static std::size_t _round_slab_size(std::size_t size)
+    {
+        std::size_t result = 4096;
+        while (result < size)
+        {
+            result *= 2;
+        }
+        return result;
+    }
+
+    bool _is_large(std::size_t size) const { return size / granularity >= class_count || size > _slab_size - header_size; }
+    bool _is_full(const slab* item) const { return !item->free && item->carve + item->size > reinterpret_cast<const char*>(item) + _slab_size; }
+
+    static void _unlink(slab*& head, slab* item)
+    {
+        if (item->prev)
+        {
+            item->prev->next = item->next;
+        }
+        else
+        {
+            head = item->next;
+        }
+
+        if (item->next)
+        {
+            item->next->prev = item->prev;
+        }
+    }
+
+    // Creates new slab (or reuses the spare one) for blocks of given size
+    slab* _new_slab(stripe& owner, std::size_t size)
+    {
+        slab* item = owner.spare;
+        owner.spare = nullptr;
+
+        if (!item)
+        {
+            item = _allocate_slab();
+        }
+
+        item->prev = nullptr;
+        item->next = nullptr;
+        item->free = nullptr;
+        item->carve = _align_block(reinterpret_cast<char*>(item) + header_size, size);
+        item->used = 0;
+        item->size = size;
+        item->owner = &owner;
+        return item;
+    }
+
+    // Allocates memory of the slab aligned to the slab size
+    slab* _allocate_slab()
+    {
+        void* memory = nullptr;
+        char* aligned = nullptr;
+        bool mapped = false;
+
+#ifdef BUSHY_HAS_MMAP
+        // Map twice the slab size and unmap the unaligned head and tail
+        void* mapping = ::mmap(nullptr, 2 * _slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping != MAP_FAILED)
+        {
+            char* begin = static_cast<char*>(mapping);
+            char* end = begin + 2 * _slab_size;
+            aligned = _align(begin);
+
+            if (aligned != begin)
+            {
+                ::munmap(begin, aligned - begin);
+            }
+            if (aligned + _slab_size != end)
+            {
+                ::munmap(aligned + _slab_size, end - (aligned + _slab_size));
+            }
+
+            memory = aligned;
+            mapped = true;
+        }
+#endif
+
+        if (!memory)
+        {
+            memory = ::operator new(2 * _slab_size);
+            aligned = _align(static_cast<char*>(memory));
+        }
+
+        slab* item = reinterpret_cast<slab*>(aligned);
+        item->memory = memory;
+        item->mapped = mapped;
+        ++_slabs;
+        return item;
+    }
+
+    void _release_slab(slab* item)
+    {
+        --_slabs;
+
+#ifdef BUSHY_HAS_MMAP
+        if (item->mapped)
+        {
+            ::munmap(item->memory, _slab_size);
+            return;
+        }
+#endif
+        ::operator delete(item->memory);
+    }
+
+    // Aligns the first block of the slab to the largest power of two dividing the block
+    // size (at most max_alignment). Block size is a multiple of the requested alignment,
+    // so all blocks of the slab are aligned, as any allocation of that size requires.
+    static char* _align_block(char* pointer, std::size_t size)
+    {
+        const std::size_t lowest_bit = size & (~size + 1);
+        const std::size_t alignment = lowest_bit < max_alignment ? lowest_bit : max_alignment;
+        const std::uintptr_t value = reinterpret_cast<std::uintptr_t>(pointer);
+        return pointer + ((alignment - value % alignment) % alignment);
+    }
+
+    // Large blocks are allocated by the global allocator. Over-aligned blocks are
+    // allocated with extra space, and the original pointer is stored before the block.
+    static void* _allocate_large(std::size_t size, std::size_t alignment)
+    {
+        if (alignment <= alignof(std::max_align_t))
+        {
+            return ::operator new(size);
+        }
+
+        char* memory = static_cast<char*>(::operator new(size + alignment));
+        char* result = memory + alignment - reinterpret_cast<std::uintptr_t>(memory) % alignment;
+        reinterpret_cast<void**>(result)[-1] = memory;
+        return result;
+    }
+
+    static void _deallocate_large(void* pointer, std::size_t alignment)
+    {
+        if (alignment <= alignof(std::max_align_t))
+        {
+            ::operator delete(pointer);
+            return;
+        }
+
+        ::operator delete(static_cast<void**>(pointer)[-1]);
+    }
+
+    char* _align(char* pointer) const
+    {
+        const std::uintptr_t value = reinterpret_cast<std::uintptr_t>(pointer);
+        return pointer + ((_slab_size - value % _slab_size) % _slab_size);
+    }
+
+    // Size of the slab (power of two)
+    std::size_t _slab_size;
+
+    // Stripes of the pool
+    std::size_t _stripe_count;
+    std::unique_ptr<stripe[]> _stripes;
+
+    // Global usage statistics
+    std::atomic<std::size_t> _used;
+    std::atomic<std::size_t> _slabs;
+};
+
+// Allocator using the shared node pool. Each allocator created from the pool counts
+// the memory of its own blocks (the count is shared by its copies, so it is the usage
+// of the map), copy of the map gets new count. Allocators are equal, if they use
+// the same pool. Allocator is propagated on move assignment and swap, so the count
+// follows the nodes, moved-from allocator gets new count.
+template<typename T>
+class shared_pool_allocator
+{
+public:
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    shared_pool_allocator(shared_node_pool* pool) : _pool(pool), _usage(std::make_shared<std::size_t>(0)) { }
+
+    shared_pool_allocator(const shared_pool_allocator&) = default;
+    shared_pool_allocator& operator=(const shared_pool_allocator&) = default;
+
+    // Count is moved with the nodes, moved-from map must be still able to allocate,
+    // and it counts its new nodes only
+    shared_pool_allocator(shared_pool_allocator&& other) : _pool(other._pool), _usage(std::move(other._usage))
+    {
+        other._usage = std::make_shared<std::size_t>(0);
+    }
+
+    shared_pool_allocator& operator=(shared_pool_allocator&& other)
+    {
+        if (this != &other)
+        {
+            _pool = other._pool;
+            _usage = std::move(other._usage);
+            other._usage = std::make_shared<std::size_t>(0);
+        }
+
+        return *this;
+    }
+
+    template<typename U>
+    shared_pool_allocator(const shared_pool_allocator<U>& other) noexcept : _pool(other._pool), _usage(other._usage) { }
+
+    T* allocate(std::size_t count)
+    {
+        static_assert(alignof(T) <= shared_node_pool::max_alignment, "Alignment greater than cache line is not supported!");
+
+        T* result = static_cast<T*>(_pool->allocate(count * sizeof(T), alignof(T)));
+        *_usage += shared_node_pool::block_size(count * sizeof(T), alignof(T));
+        return result;
+    }
+
+    void deallocate(T* pointer, std::size_t count)
+    {
+        _pool->deallocate(pointer, count * sizeof(T), alignof(T));
+        *_usage -= shared_node_pool::block_size(count * sizeof(T), alignof(T));
+    }
+
+    shared_pool_allocator select_on_container_copy_construction() const { return shared_pool_allocator(_pool); }
+
+    shared_node_pool* pool() const { return _pool; }
+
+    // Returns count of the bytes allocated by this allocator (and its copies)
+    std::size_t usage() const { return *_usage; }
+
+private:
+    template<typename U>
+    friend class shared_pool_allocator;
+
+    shared_node_pool* _pool;
+    std::shared_ptr<std::size_t> _usage;
+};
+
+template<typename T, typename U>
+bool operator==(const shared_pool_allocator<T>& l, const shared_pool_allocator<U>& r) { return l.pool() == r.pool(); }
+
+template<typename T, typename U>
+bool operator!=(const shared_pool_allocator<T>& l, const shared_pool_allocator<U>& r) { return l.pool() != r.pool(); }
+
+// Shared pool allocator knows the memory usage of the map
+template<typename T>
+struct allocator_memory_usage<shared_pool_allocator<T>>
+{
+    static constexpr bool is_tracked = true;
+    static unsigned long long usage(const shared_pool_allocator<T>& allocator) { return allocator.usage(); }
+};
+
+}   // namespace bushy
+
+#endif // BUSHY_SHARED_NODE_POOL_H
@@ -21,13 +21,36 @@
 #ifndef BUSHY_SPLAY_MAP_H
 #define BUSHY_SPLAY_MAP_H
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
 #include <utility>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <type_traits>
 #include <limits>
+#include <vector>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+#if defined(__has_include)
+#if __has_include(<span>) && (__cplusplus > 201703L || (defined(_MSVC_LANG) && _MSVC_LANG > 201703L))
+#include <span>
+#define BUSHY_HAS_SPAN
+#endif
+#endif
+
+#if defined(__has_include)
+#if __has_include(<memory_resource>) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#include <memory_resource>
+#define BUSHY_HAS_MEMORY_RESOURCE
+#endif
+#endif
 
 namespace bushy
 {
@@ -36,11 +59,47 @@ namespace bushy
 // will be triggered during some operations.
 enum class splay_mode
 {
-    ALWAYS, // Node is splayed at every operation
-    HALF,   // Node is splayed every second operation
-    THIRD,  // Node is splayed every third operation
-    FOURTH, // Node is splayed every fourth operation
-    NEVER   // Node is never splayed
+    ALWAYS,     // Node is splayed at every operation
+    HALF,       // Node is splayed every second operation
+    THIRD,      // Node is splayed every third operation
+    FOURTH,     // Node is splayed every fourth operation
+    NEVER,      // Node is never splayed
+    TOP_DOWN,   // As ALWAYS, but insertion splays the tree in one top-down pass
+    DEFERRED    // As ALWAYS, but lookups only queue the found node, queued nodes are
+                // splayed together, when the queue is full (or by flush_splays())
+};
+
+// Defines the prefetch mode policy. Specifies, which nodes are loaded
+// to the cache ahead, when the tree is searched or iterated.
+enum class prefetch_mode
+{
+    NONE,       // Nothing is prefetched
+    CHILDREN    // Both children of the visited node are prefetched (during the descent),
+                // successor's subtree is prefetched (during the iteration)
+};
+
+// Defines the node alignment policy. Nodes of small maps often straddle the
+// cache line boundary, so the search touching the links and the key of the node
+// loads two cache lines. Aligned nodes never straddle the boundary of the aligned
+// block, at the cost of the padding of the node.
+enum class node_alignment
+{
+    NATURAL,    // Node has alignment of its members, it is not padded
+    HALF_LINE,  // Node is aligned (and padded) to 32 bytes
+    CACHE_LINE  // Node is aligned (and padded) to 64 bytes
+};
+
+// Defines the erase mode policy. Specifies, how the erased node is removed
+// from the tree. Splaying the erased node restructures the tree around the
+// key, which is wasted work, if the erased keys are not accessed again.
+enum class erase_mode
+{
+    SPLAY,              // Node is splayed to the root and then removed
+    UNLINK,             // Node is unlinked in place (replaced by its successor), erase by
+                        // key splays its parent, if the find policy requires splaying
+    UNLINK_SPLAY_PARENT,// Node is unlinked in place and its parent is splayed
+    TOMBSTONE           // Node is marked dead and left in the tree, dead nodes are
+                        // removed together, when they are more than half of the nodes
 };
 
 namespace impl
@@ -86,6 +145,201 @@ struct splay_decider<splay_mode::NEVER>
     constexpr bool splay_hint() const { return false; }
 };
 
+template<>
+struct splay_decider<splay_mode::TOP_DOWN>
+{
+    constexpr bool splay_hint() const { return true; }
+};
+
+template<>
+struct splay_decider<splay_mode::DEFERRED>
+{
+    constexpr bool splay_hint() const { return true; }
+};
+
+// Mark of the node erased lazily (tombstone). Nodes of the maps,
+// which remove the erased nodes immediately, are never dead.
+template<bool Lazy>
+struct node_mark
+{
+    constexpr bool is_dead() const { return false; }
+    void set_dead(bool) { }
+};
+
+template<>
+struct node_mark<true>
+{
+    bool dead = false;
+
+    bool is_dead() const { return dead; }
+    void set_dead(bool value) { dead = value; }
+};
+
+// Queue of the nodes found by the lookups, which are splayed later together
+// (deferred splay mode). Maps, which splay immediately, have no queue.
+template<typename Node, bool Deferred>
+struct splay_queue
+{
+    bool push(Node*) { return false; }
+    void remove(const Node*) { }
+    void clear() { }
+
+    template<typename Splay>
+    void flush(Splay) { }
+};
+
+template<typename Node>
+struct splay_queue<Node, true>
+{
+    static constexpr std::size_t capacity = 32;
+
+    Node* nodes[capacity];
+    std::size_t count = 0;
+
+    // Appends the node (repeated access to the same node is queued once),
+    // returns true, if the queue is full and must be flushed
+    bool push(Node* node)
+    {
+        if (count == 0 || nodes[count - 1] != node)
+        {
+            nodes[count++] = node;
+        }
+
+        return count == capacity;
+    }
+
+    // Removes the node from the queue (destroyed node must not be splayed)
+    void remove(const Node* node)
+    {
+        if (count > 0)
+        {
+            count = std::remove(nodes, nodes + count, node) - nodes;
+        }
+    }
+
+    void clear() { count = 0; }
+
+    // Splays the queued nodes in the order of the access, so the last
+    // accessed node becomes the root
+    template<typename Splay>
+    void flush(Splay splay)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            splay(nodes[i]);
+        }
+
+        count = 0;
+    }
+};
+
+// Evictor, which does nothing with the evicted values
+struct null_evictor
+{
+    template<typename Value>
+    void operator()(Value&) const { }
+};
+
+// Hints the processor to load the memory pointed by the pointer to the cache
+inline void prefetch(const void* pointer)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(pointer);
+#elif defined(_MSC_VER)
+    _mm_prefetch(static_cast<const char*>(pointer), _MM_HINT_T0);
+#else
+    (void)pointer;
+#endif
+}
+
+// Stack of the nodes used in the tree traversal. Small stacks are stored
+// inside this object, deep stacks use the heap memory.
+template<typename Node>
+class node_stack
+{
+public:
+    bool empty() const { return _size == 0; }
+
+    void push(Node node)
+    {
+        if (_size < InlineCapacity)
+        {
+            _inline[_size] = node;
+        }
+        else
+        {
+            _overflow.push_back(node);
+        }
+
+        ++_size;
+    }
+
+    Node pop()
+    {
+        --_size;
+
+        if (_size < InlineCapacity)
+        {
+            return _inline[_size];
+        }
+
+        Node node = _overflow.back();
+        _overflow.pop_back();
+        return node;
+    }
+
+private:
+    static constexpr std::size_t InlineCapacity = 64;
+
+    std::size_t _size = 0;
+    Node _inline[InlineCapacity];
+    std::vector<Node> _overflow;
+};
+
+// Calls the visitor with the value. Returns false, if the visitor wants to stop
+// the visitation (visitor returning false). Visitors returning void never stop it.
+template<typename Visitor, typename Value>
+inline auto visit(Visitor& visitor, Value& value) -> typename std::enable_if<std::is_void<decltype(visitor(value))>::value, bool>::type
+{
+    visitor(value);
+    return true;
+}
+
+template<typename Visitor, typename Value>
+inline auto visit(Visitor& visitor, Value& value) -> typename std::enable_if<!std::is_void<decltype(visitor(value))>::value, bool>::type
+{
+    return static_cast<bool>(visitor(value));
+}
+
+// Visitor, which copies the keys and values into the separate arrays,
+// until the capacity is exhausted.
+template<typename Key, typename T>
+struct exporter
+{
+    explicit exporter(Key* keys, T* values, std::size_t capacity) : keys(keys), values(values), capacity(capacity), count(0) { }
+
+    template<typename Value>
+    bool operator()(const Value& value)
+    {
+        if (keys)
+        {
+            keys[count] = value.first;
+        }
+
+        if (values)
+        {
+            values[count] = value.second;
+        }
+
+        return ++count < capacity;
+    }
+
+    Key* keys;
+    T* values;
+    std::size_t capacity;
+    std::size_t count;
+};
+
 }   // namespace private
 
 // Policy, which defines the behaviour of the splay
@@ -94,13 +348,94 @@ struct splay_decider<splay_mode::NEVER>
 // NOTE: variables must be mutable, because we are modifying
 // the internal state of the tree even for 'const' functions,
 // so we mark the policies as mutable.
-template<splay_mode Insert, splay_mode Find>
+template<splay_mode Insert, splay_mode Find, prefetch_mode Prefetch = prefetch_mode::NONE, node_alignment Alignment = node_alignment::NATURAL, erase_mode Erase = erase_mode::SPLAY>
 struct splay_map_policy
 {
+    static constexpr prefetch_mode prefetch = Prefetch;
+    static constexpr node_alignment alignment = Alignment;
+    static constexpr erase_mode erase = Erase;
+
     mutable impl::splay_decider<Insert> insert_policy;
     mutable impl::splay_decider<Find> find_policy;
 };
 
+namespace impl
+{
+
+// Trait, which returns the prefetch mode of the policy. Custom policies
+// without the prefetch member do not prefetch.
+template<typename Policy, typename = void>
+struct policy_prefetch : std::integral_constant<prefetch_mode, prefetch_mode::NONE> { };
+
+template<typename Policy>
+struct policy_prefetch<Policy, decltype(void(Policy::prefetch))> : std::integral_constant<prefetch_mode, Policy::prefetch> { };
+
+// Trait, which returns the node alignment in bytes required by the policy (zero,
+// if the node has natural alignment). Custom policies without the alignment
+// member use natural alignment.
+template<typename Policy, typename = void>
+struct policy_alignment : std::integral_constant<std::size_t, 0> { };
+
+template<typename Policy>
+struct policy_alignment<Policy, decltype(void(Policy::alignment))> :
+        std::integral_constant<std::size_t, Policy::alignment == node_alignment::CACHE_LINE ? 64 : (Policy::alignment == node_alignment::HALF_LINE ? 32 : 0)> { };
+
+// Maximum of the values, usable in the constant expressions (std::max is not constexpr in C++11)
+constexpr std::size_t max_value(std::size_t value) { return value; }
+
+template<typename... Values>
+constexpr std::size_t max_value(std::size_t first, std::size_t second, Values... rest) { return max_value(first > second ? first : second, rest...); }
+
+// Trait, which returns the erase mode of the policy. Custom policies
+// without the erase member splay the erased nodes.
+template<typename Policy, typename = void>
+struct policy_erase : std::integral_constant<erase_mode, erase_mode::SPLAY> { };
+
+template<typename Policy>
+struct policy_erase<Policy, decltype(void(Policy::erase))> : std::integral_constant<erase_mode, Policy::erase> { };
+
+}   // namespace impl
+
+// Trait, which enables the search functions specialized for integral keys (with
+// single ordering comparison per level and branch-free selection of the child node).
+// It is enabled for integral keys compared by std::less, it can be specialized
+// for other key types and comparators, which are equivalent to operator <.
+template<typename Key, typename Compare>
+struct is_integral_key_compare : std::integral_constant<bool, std::is_integral<Key>::value &&
+                                                              (std::is_same<Compare, std::less<Key>>::value || std::is_same<Compare, std::less<void>>::value)>
+{
+
+};
+
+// Trait, which tells, if the allocator releases its memory in bulk (for example,
+// when the arena is destroyed), so deallocation of the individual nodes is not
+// needed. The tree with trivially destructible values is then cleared in O(1).
+// It can be specialized for custom arena allocators.
+template<typename Allocator>
+struct allocator_bulk_release
+{
+    static bool is_bulk(const Allocator&) { return false; }
+};
+
+#ifdef BUSHY_HAS_MEMORY_RESOURCE
+// Polymorphic allocator releases in bulk, if it uses the monotonic buffer resource
+template<typename T>
+struct allocator_bulk_release<std::pmr::polymorphic_allocator<T>>
+{
+    static bool is_bulk(const std::pmr::polymorphic_allocator<T>& allocator) { return dynamic_cast<std::pmr::monotonic_buffer_resource*>(allocator.resource()) != nullptr; }
+};
+#endif
+
+// Trait, which tells, how many bytes the allocator holds for the nodes of the map.
+// Allocators, which track their usage (for example the shared node pool), specialize
+// it, so memory_consumption() reports the real memory instead of the estimate.
+template<typename Allocator>
+struct allocator_memory_usage
+{
+    static constexpr bool is_tracked = false;
+    static unsigned long long usage(const Allocator&) { return 0; }
+};
+
 // Splay map - STL like container implemented as splay tree.
 // Custom compare function and allocator can be used, and
 // also custom splay policy for splaying can be used.
@@ -137,7 +472,8 @@ public:
     // Iterator implementation. It is implemented as template, so we do not need
     // two iterator classes. It uses types from this map class, and is parametrized
     // by Value, which can be either const value_type (for constant iterator), or
-    // value_type (for non-constant iterator).
+    // value_type (for non-constant iterator). Iterator holds only the pointer to the node,
+    // end iterator holds the pointer to the root of the map marked by its lowest bit.
     template<typename Value>
     class iterator_impl : public std::iterator<std::bidirectional_iterator_tag,
             Value,
@@ -146,7 +482,7 @@ public:
             typename std::conditional<std::template is_const<Value>::value, const_reference, reference>::type>
     {
     public:
-        iterator_impl() : _node(nullptr), _proxy(nullptr) { }
+        iterator_impl() : _node(nullptr) { }
         iterator_impl(const iterator_impl& other) = default; // default copy constructor; we just copy pointers
         ~iterator_impl() = default; // we do not need extra functionality here
 
@@ -158,8 +494,7 @@ public:
         // the type ValueFrom to the type Value;
         template<typename ValueFrom>
         iterator_impl(const iterator_impl<ValueFrom>& other, typename std::enable_if<std::template is_convertible<ValueFrom, Value>::value, int>::type = int()) :
-            _node(other._node),
-            _proxy(other._proxy)
+            _node(other._node)
         {
 
         }
@@ -172,53 +507,63 @@ public:
 
         iterator_impl& operator++()
         {
-            _node = _proxy->_next(_node);
+            base_node* node = _get();
+
+            do
+            {
+                base_node* next = node->child[RIGHT];
+
+                if (next->child[RIGHT] == node)
+                {
+                    // Node is the maximum, its right child is the root of the map
+                    _node = _mark_end(next);
+                    return *this;
+                }
+
+                node = splay_map::_step(node, RIGHT);
+            }
+            while (node->asNode()->is_dead());
+
+            _node = node;
+            splay_map::_prefetch_neighbour(_node, RIGHT);
             return *this;
         }
 
         iterator_impl operator++(int)
         {
             iterator_impl temp(*this);
-            _node = _proxy->_next(_node);
+            ++*this;
             return temp;
         }
 
         iterator_impl& operator--()
         {
-            _node = _proxy->_prev(_node);
+            base_node* node = _get();
+
+            do
+            {
+                node = splay_map::_step(node, LEFT);
+            }
+            while (node->asNode()->is_dead());
+
+            _node = node;
+            splay_map::_prefetch_neighbour(_node, LEFT);
             return *this;
         }
 
         iterator_impl operator--(int)
         {
             iterator_impl temp(*this);
-            _node = _proxy->_prev(_node);
+            --*this;
             return temp;
         }
 
+        // Valid iterators are equal, if they point to the same node (nodes are owned
+        // by the map, so the node pointers are unique). End iterators (and default
+        // constructed iterators) are all equal.
         bool operator==(const iterator_impl& other) const
         {
-            const bool isNullLeft = !_proxy || &_proxy->_root == _node;
-            const bool isNullRight = !other._proxy || &other._proxy->_root == other._node;
-
-            if (isNullLeft != isNullRight)
-            {
-                // One iterator is end iterator, other is valid.
-                return false;
-            }
-
-            if (isNullLeft && isNullRight)
-            {
-                // Both iterators are invalid (pass-the-end iterators)
-                return true;
-            }
-
-            // Now, both iterators are valid, we compare if they points to the same
-            // node (we can simply test the node pointers, because the map owns the node,
-            // pointers are unique). So it cannot happen situation, where node pointers are
-            // equal, but proxies not.
-
-            return _node == other._node;
+            return _node == other._node || (_is_end() && other._is_end());
         }
 
         // Template version for comparation of constant and non-constant iterators
@@ -245,7 +590,6 @@ public:
         void swap(iterator_impl& other)
         {
             std::swap(_node, other._node);
-            std::swap(_proxy, other._proxy);
         }
 
     private:
@@ -253,20 +597,33 @@ public:
         // but they are needed, because we must allow create the iterator from the const object.
         // The constantness is achieved via interface (const functions of the map should not
         // return non-const iterator).
-        explicit iterator_impl(const base_node* node, const splay_map* proxy) : _node(const_cast<base_node*>(node)), _proxy(const_cast<splay_map*>(proxy)) { }
+        explicit iterator_impl(const base_node* node, const splay_map* proxy) : _node(node == &proxy->_root ? _mark_end(&proxy->_root) : const_cast<base_node*>(node)) { }
+
+        // Creates the iterator holding the (possibly marked) pointer
+        explicit iterator_impl(base_node* node) : _node(node) { }
+
+        // End iterator is marked by the lowest bit of the pointer to the root of the map,
+        // so it is recognized without the map. Nodes are aligned at least to the pointer
+        // size, so the lowest bit of the valid node pointer is zero.
+        static base_node* _mark_end(base_node* root) { return reinterpret_cast<base_node*>(reinterpret_cast<std::uintptr_t>(root) | 1); }
+
+        // Returns true for the end iterator and for the default constructed iterator
+        bool _is_end() const { return !_node || (reinterpret_cast<std::uintptr_t>(_node) & 1); }
+
+        // Returns the node (the root of the map for the end iterator)
+        base_node* _get() const { return reinterpret_cast<base_node*>(reinterpret_cast<std::uintptr_t>(_node) & ~static_cast<std::uintptr_t>(1)); }
 
         // Converts the other iterator type to this iterator type
         template<typename OtherValue>
         iterator_impl const_cast_iterator(const iterator_impl<OtherValue>& iterator) const
         {
-            return iterator_impl(iterator._node, iterator._proxy);
+            return iterator_impl(iterator._node);
         }
 
         // To allow use of private constructor in the splay map
         friend class splay_map;
 
         base_node* _node;
-        splay_map* _proxy;
     };
 
     using iterator = iterator_impl<value_type>;
@@ -305,7 +662,8 @@ public:
         _root{&_root, &_root, &_root},
         _comp(comp),
         _alloc(alloc),
-        _size(0)
+        _size(0),
+        _tombstones(0)
     {
 
     }
@@ -343,6 +701,7 @@ public:
         _comp(std::move(other._comp)),
         _alloc(std::move(other._alloc)),
         _size(other._size),
+        _tombstones(other._tombstones),
         _policy()
     {
         other._replant(&_root);
@@ -353,16 +712,21 @@ public:
         _comp(other._comp),
         _alloc(alloc),
         _size(0),
+        _tombstones(0),
         _policy()
     {
         if (alloc != other.get_allocator())
         {
-            // Allocator are not equal, use copy semantics
-            insert(other.cbegin(), other.cend());
+            // Allocator are not equal, we must move the elements one by one
+            _move_elements(other);
         }
         else
         {
+            // Equal allocator of the other map is taken with its nodes (if it can
+            // be propagated), so the state of the allocator follows the nodes
+            _propagate_allocator(std::move(other._alloc), typename node_traits::propagate_on_container_move_assignment());
             _size = other._size;
+            _tombstones = other._tombstones;
             other._replant(&_root);
         }
     }
@@ -392,16 +756,20 @@ public:
             return *this;
         }
 
-        // First, clear the old data using old allocator
-        clear();
-
-        if (std::allocator_traits<allocator_type>::propagate_on_container_copy_assignment::value)
+        if (node_traits::propagate_on_container_copy_assignment::value && _alloc != other._alloc)
+        {
+            // First, clear the old data using old allocator, then propagate the allocator
+            clear();
+            _propagate_allocator(other._alloc, typename node_traits::propagate_on_container_copy_assignment());
+            insert(other.cbegin(), other.cend());
+        }
+        else
         {
-            // We must propagate the allocator to this object
-            _alloc = other._alloc;
+            // Nodes of this map can be reused for the new data
+            _propagate_allocator(other._alloc, typename node_traits::propagate_on_container_copy_assignment());
+            assign(other.cbegin(), other.cend());
         }
 
-        insert(other.cbegin(), other.cend());
         return *this;
     }
 
@@ -416,23 +784,18 @@ public:
         // First clear the map
         clear();
 
-        if (std::allocator_traits<allocator_type>::propagate_on_container_move_assignment::value)
-        {
-            _alloc = other._alloc;
-
-            // Move the data
-            _size = other._size;
-            other._replant(&_root);
-        }
-        else if (!(_alloc != other.get_allocator()))
+        if (node_traits::propagate_on_container_move_assignment::value || !(_alloc != other._alloc))
         {
-            // Allocators are equal, we can move the data
+            // Propagate the allocator (if it is required) and move the data
+            _propagate_allocator(std::move(other._alloc), typename node_traits::propagate_on_container_move_assignment());
             _size = other._size;
+            _tombstones = other._tombstones;
             other._replant(&_root);
         }
         else
         {
-            insert(other.cbegin(), other.cend());
+            // Allocators are not equal, we must move the elements one by one
+            _move_elements(other);
         }
 
         return *this;
@@ -440,13 +803,38 @@ public:
 
     splay_map& operator=(std::initializer_list<value_type> ilist)
     {
-        clear();
-        insert(ilist.begin(), ilist.end());
+        assign(ilist.begin(), ilist.end());
         return *this;
     }
 
+    // Replaces the contents of the map by the range [first, last). Nodes of the old
+    // contents are reused for the new values (values are destroyed and constructed
+    // again in place), so if the map is refreshed periodically with the contents of
+    // similar size, nothing is allocated.
+    template<class InputIt>
+    void assign(InputIt first, InputIt last)
+    {
+        base_node* chain = _harvest_nodes();
+
+        try
+        {
+            for (; first != last; ++first)
+            {
+                // We assume that we are assigning sorted sequence (as in insert)
+                _emplace_node_hint(cend(), true, _recycle_node(chain, *first));
+            }
+        }
+        catch (...)
+        {
+            _release_chain(chain);
+            throw;
+        }
+
+        _release_chain(chain);
+    }
+
     // Allocator functions
-    allocator_type get_allocator() const { return _alloc; }
+    allocator_type get_allocator() const { return allocator_type(_alloc); }
 
     // Element access functions
 
@@ -510,9 +898,9 @@ public:
 
     // Iterators
 
-    iterator begin() { return iterator(_root.left, this); }
-    const_iterator begin() const { return const_iterator(_root.left, this); }
-    const_iterator cbegin() const { return const_iterator(_root.left, this); }
+    iterator begin() { return iterator(_root.child[LEFT], this); }
+    const_iterator begin() const { return const_iterator(_root.child[LEFT], this); }
+    const_iterator cbegin() const { return const_iterator(_root.child[LEFT], this); }
 
     iterator end() { return iterator(&_root, this); }
     const_iterator end() const { return const_iterator(&_root, this); }
@@ -528,8 +916,8 @@ public:
 
     // Capacity
 
-    bool empty() const { return _size == 0; }
-    size_type size() const { return _size; }
+    bool empty() const { return _size == _tombstones; }
+    size_type size() const { return _size - _tombstones; }
     size_type max_size() const { return std::numeric_limits<size_type>::max() / memory_consumption_item(); }
 
     // Modifiers
@@ -587,6 +975,109 @@ public:
         insert(ilist.begin(), ilist.end());
     }
 
+    // Inserts the unsorted range [first, last) as a batch. All nodes are created first,
+    // then they are sorted by the key and merged into the tree - by linear rebuild of
+    // the whole tree, if the batch is large relative to the map, or by finger insertion
+    // without splaying, if it is small. If the batch contains more values with the same
+    // key, only the first one is inserted. Returns count of inserted elements.
+    template<class InputIt>
+    size_type insert_batch(InputIt first, InputIt last)
+    {
+        compact();
+
+        std::vector<base_node*> batch;
+        _buy_nodes(first, last, batch);
+
+        if (batch.empty())
+        {
+            return 0;
+        }
+
+        auto compare = [this](const base_node* left, const base_node* right) { return _comp(left->asNode()->value.first, right->asNode()->value.first); };
+        std::stable_sort(batch.begin(), batch.end(), compare);
+
+        // Remove duplicates from the batch (first value with the same key is used)
+        auto unique_end = batch.begin();
+        for (auto it = std::next(batch.begin()); it != batch.end(); ++it)
+        {
+            if (compare(*unique_end, *it))
+            {
+                *++unique_end = *it;
+            }
+            else
+            {
+                _orphan_node(*it);
+            }
+        }
+        batch.erase(std::next(unique_end), batch.end());
+
+        const size_type old_size = _size;
+
+        if (batch.size() * 4 >= _size)
+        {
+            // Batch is large, merge the tree and the batch and rebuild the tree
+            std::vector<base_node*> merged;
+            merged.reserve(_size + batch.size());
+
+            auto batch_it = batch.begin();
+            for (base_node* current = _root.child[LEFT]; current != &_root; current = _next(current))
+            {
+                for (; batch_it != batch.end() && compare(*batch_it, current); ++batch_it)
+                {
+                    merged.push_back(*batch_it);
+                }
+
+                if (batch_it != batch.end() && !compare(current, *batch_it))
+                {
+                    // Key is already in the map
+                    _orphan_node(*batch_it);
+                    ++batch_it;
+                }
+
+                merged.push_back(current);
+            }
+            merged.insert(merged.end(), batch_it, batch.end());
+
+            _rebuild(merged);
+        }
+        else
+        {
+            // Batch is small, insert each node by finger search from the previously
+            // inserted node.
+            base_node* finger = _root.parent;
+
+            for (base_node* node : batch)
+            {
+                base_node* bound = _finger_lower_bound(finger, node->asNode()->value.first);
+
+                if (bound != &_root && !compare(node, bound))
+                {
+                    // Key is already in the map
+                    _orphan_node(node);
+                    continue;
+                }
+
+                // Insert the node immediately before the bound
+                if (bound == &_root)
+                {
+                    _link_node(node, _root.child[RIGHT], true);
+                }
+                else if (bound->child[LEFT] == &_root)
+                {
+                    _link_node(node, bound, false);
+                }
+                else
+                {
+                    _link_node(node, _max(bound->child[LEFT]), true);
+                }
+
+                finger = node;
+            }
+        }
+
+        return _size - old_size;
+    }
+
     template<class M>
     std::pair<iterator, bool> insert_or_assign(const key_type& k, M&& obj)
     {
@@ -649,33 +1140,224 @@ public:
 
     iterator erase(const_iterator pos)
     {
-        return _erase(pos._node);
+        return _erase(pos._get());
     }
 
     iterator erase(iterator pos)
     {
-        return _erase(pos._node);
+        return _erase(pos._get());
     }
 
     iterator erase(const_iterator first, const_iterator last)
     {
-        for (const_iterator it = first; it != last; it = _erase(it._node));
+        for (const_iterator it = first; it != last; it = _erase(it._get()));
 
         return last;
     }
 
     size_type erase(const key_type& key)
     {
-        base_node* node = _find(key);
+        if (erase_splay::value || tombstone_erase::value)
+        {
+            // Lookup follows the find policy, the erase mode decides the rest
+            base_node* node = _find(key);
+            if (node != &_root)
+            {
+                _erase(node);
+                return 1;
+            }
+
+            return 0;
+        }
+
+        // Node unlinked in place is not splayed. Its parent is splayed instead (as the
+        // find policy requires, or always, if the erase mode says so), never splaying
+        // the deep paths would keep the tree unbalanced.
+        base_node* node = _find_node(key, integral_search());
         if (node != &_root)
         {
+            base_node* parent = node->parent;
             _erase(node);
+
+            if (impl::policy_erase<Policy>::value == erase_mode::UNLINK && parent != &_root)
+            {
+                _splay_found(parent);
+            }
+
             return 1;
         }
-        else
-        {
-            return 0;
-        }
+
+        return 0;
+    }
+
+    // Removes all elements with key lesser than the key. The tree is split
+    // by a single splay of the lower bound of the key, and the detached part
+    // is destroyed in linear time. Returns count of removed elements.
+    size_type expire_before(const key_type& key)
+    {
+        impl::null_evictor evictor;
+        return expire_before(key, evictor);
+    }
+
+    // Removes all elements with key lesser than the key. Evictor is called
+    // with each removed value (in sorted order) before it is destroyed.
+    template<class Evictor>
+    size_type expire_before(const key_type& key, Evictor evictor)
+    {
+        compact();
+
+        base_node* bound = _lower_bound_node(key);
+
+        if (bound == &_root)
+        {
+            // All elements are lesser than the key
+            return _dispose_all(evictor);
+        }
+
+        // Splay the bound, so all lesser elements are in its left subtree
+        _splay(bound);
+
+        base_node* detached = bound->child[LEFT];
+        if (detached == &_root)
+        {
+            // Bound is minimum of the map, nothing to expire
+            return 0;
+        }
+
+        bound->child[LEFT] = &_root;
+        _root.child[LEFT] = bound;
+        return _dispose_subtree(detached, evictor);
+    }
+
+    // Removes all elements with key greater than the key. The tree is split
+    // by a single splay of the last element not greater than the key, and
+    // the detached part is destroyed in linear time. Returns count of removed elements.
+    size_type expire_after(const key_type& key)
+    {
+        impl::null_evictor evictor;
+        return expire_after(key, evictor);
+    }
+
+    // Removes all elements with key greater than the key. Evictor is called
+    // with each removed value (in sorted order) before it is destroyed.
+    template<class Evictor>
+    size_type expire_after(const key_type& key, Evictor evictor)
+    {
+        compact();
+
+        base_node* bound = _floor_node(key);
+
+        if (bound == &_root)
+        {
+            // All elements are greater than the key
+            return _dispose_all(evictor);
+        }
+
+        // Splay the bound, so all greater elements are in its right subtree
+        _splay(bound);
+
+        base_node* detached = bound->child[RIGHT];
+        if (detached == &_root)
+        {
+            // Bound is maximum of the map, nothing to expire
+            return 0;
+        }
+
+        bound->child[RIGHT] = &_root;
+        _root.child[RIGHT] = bound;
+        return _dispose_subtree(detached, evictor);
+    }
+
+    // Removes the keys from the sorted range [first, last) (sorted by the key comparator
+    // of this map) in one pass. Each key is searched from the place of the previous one
+    // (finger search), nodes are unlinked without splaying and the minimum/maximum
+    // pointers are fixed only once at the end. Returns count of removed elements.
+    template<class InputIt>
+    size_type erase_sorted(InputIt first, InputIt last)
+    {
+        compact();
+
+        size_type count = 0;
+        base_node* finger = _root.parent;
+
+        for (; first != last && finger != &_root; ++first)
+        {
+            const key_type& key = *first;
+            base_node* bound = _finger_lower_bound(finger, key);
+
+            if (bound != &_root && !_comp(key, bound->asNode()->value.first))
+            {
+                // We have found the key, remove it and continue from the place of removal
+                finger = _unlink_node(bound);
+                _orphan_node(bound);
+                --_size;
+                ++count;
+            }
+            else
+            {
+                // Key is not in the map, continue from its lower bound
+                finger = bound;
+            }
+        }
+
+        if (count > 0)
+        {
+            if (_root.parent != &_root)
+            {
+                _root.child[LEFT] = _min(_root.parent);
+                _root.child[RIGHT] = _max(_root.parent);
+            }
+            else
+            {
+                _root.child[LEFT] = &_root;
+                _root.child[RIGHT] = &_root;
+            }
+        }
+
+        return count;
+    }
+
+    // Removes the tombstones (nodes erased lazily) from the map and rebuilds
+    // the tree in linear time. Does nothing, if there are no tombstones.
+    void compact()
+    {
+        if (_tombstones == 0)
+        {
+            return;
+        }
+
+        std::vector<base_node*> nodes;
+        nodes.reserve(_size);
+
+        for (base_node* current = _root.child[LEFT]; current != &_root; current = _next(current))
+        {
+            nodes.push_back(current);
+        }
+
+        // Tombstones are destroyed after the traversal, which walks through them
+        auto live_end = nodes.begin();
+        for (base_node* current : nodes)
+        {
+            if (current->asNode()->is_dead())
+            {
+                _orphan_node(current);
+            }
+            else
+            {
+                *live_end++ = current;
+            }
+        }
+        nodes.erase(live_end, nodes.end());
+
+        _rebuild(nodes);
+    }
+
+    // Splays the nodes queued by the lookups (deferred splay mode), in the order
+    // of the access. Lookups flush the queue, when it is full, so the lookups
+    // between the flushes only read the tree. Does nothing in other modes.
+    void flush_splays() const
+    {
+        _splays.flush([this](base_node* node) { _splay(node); });
     }
 
     void swap(splay_map& other)
@@ -720,6 +1402,21 @@ public:
         return const_iterator(_find<K>(key), this);
     }
 
+    // Finds the key, searching outward from the hint (finger search). Search climbs
+    // from the hint to the lowest ancestor, whose subtree must contain the key, and
+    // then descends, so it is fast, when the key is near the hint (O(log d) amortized,
+    // where d is the count of elements between the hint and the key). Found node
+    // is splayed according to the find policy. End iterator is a valid hint.
+    iterator find(const_iterator hint, const Key& key)
+    {
+        return iterator(_find(hint._get(), key), this);
+    }
+
+    const_iterator find(const_iterator hint, const Key& key) const
+    {
+        return const_iterator(_find(hint._get(), key), this);
+    }
+
     std::pair<iterator, iterator> equal_range(const Key& key)
     {
         return std::make_pair(lower_bound(key), upper_bound(key));
@@ -764,6 +1461,18 @@ public:
         return const_iterator(_lower_bound<K>(key), this);
     }
 
+    // Finds the lower bound, searching outward from the hint (finger search),
+    // see find(hint, key).
+    iterator lower_bound(const_iterator hint, const Key& key)
+    {
+        return iterator(_lower_bound(hint._get(), key), this);
+    }
+
+    const_iterator lower_bound(const_iterator hint, const Key& key) const
+    {
+        return const_iterator(_lower_bound(hint._get(), key), this);
+    }
+
     iterator upper_bound(const Key& key)
     {
         return iterator(_upper_bound(key), this);
@@ -786,6 +1495,114 @@ public:
         return const_iterator(_upper_bound<K>(key), this);
     }
 
+    // Visitation - calls the visitor for the values in sorted order (or in reverse order)
+    // without iterators and without splaying, the tree is traversed using an explicit
+    // stack. If the visitor returns bool, then returning false stops the visitation.
+    // Functions return false, if the visitation was stopped.
+
+    template<class Visitor>
+    bool for_each(Visitor visitor)
+    {
+        return _visit_all<value_type, false>(visitor);
+    }
+
+    template<class Visitor>
+    bool for_each(Visitor visitor) const
+    {
+        return _visit_all<const value_type, false>(visitor);
+    }
+
+    template<class Visitor>
+    bool for_each_reverse(Visitor visitor)
+    {
+        return _visit_all<value_type, true>(visitor);
+    }
+
+    template<class Visitor>
+    bool for_each_reverse(Visitor visitor) const
+    {
+        return _visit_all<const value_type, true>(visitor);
+    }
+
+    // Visits the values with keys in the range [low, high).
+    template<class Visitor>
+    bool for_each_range(const Key& low, const Key& high, Visitor visitor)
+    {
+        return _visit_range<value_type, false>(low, high, visitor);
+    }
+
+    template<class Visitor>
+    bool for_each_range(const Key& low, const Key& high, Visitor visitor) const
+    {
+        return _visit_range<const value_type, false>(low, high, visitor);
+    }
+
+    // Visits the values with keys in the range [low, high) in reverse order.
+    template<class Visitor>
+    bool for_each_range_reverse(const Key& low, const Key& high, Visitor visitor)
+    {
+        return _visit_range<value_type, true>(low, high, visitor);
+    }
+
+    template<class Visitor>
+    bool for_each_range_reverse(const Key& low, const Key& high, Visitor visitor) const
+    {
+        return _visit_range<const value_type, true>(low, high, visitor);
+    }
+
+    // Export - copies the keys and/or values in sorted order into the caller's buffers
+    // (struct of arrays), at most capacity items are copied. Tree is not splayed, it is
+    // traversed in the same way as in the for_each function. Buffer pointers can be null,
+    // then nothing is copied into them. Functions return count of exported items.
+
+    size_type export_keys(Key* keys, size_type capacity) const
+    {
+        return export_all(keys, nullptr, capacity);
+    }
+
+    size_type export_values(T* values, size_type capacity) const
+    {
+        return export_all(nullptr, values, capacity);
+    }
+
+    size_type export_all(Key* keys, T* values, size_type capacity) const
+    {
+        impl::exporter<Key, T> exporter(keys, values, capacity);
+
+        if (capacity > 0)
+        {
+            _visit_all<const value_type, false>(exporter);
+        }
+
+        return exporter.count;
+    }
+
+    // Exports the items with keys in the range [low, high).
+    size_type export_range(const Key& low, const Key& high, Key* keys, T* values, size_type capacity) const
+    {
+        impl::exporter<Key, T> exporter(keys, values, capacity);
+
+        if (capacity > 0)
+        {
+            _visit_range<const value_type, false>(low, high, exporter);
+        }
+
+        return exporter.count;
+    }
+
+#if defined(BUSHY_HAS_SPAN)
+    size_type export_keys(std::span<Key> keys) const { return export_keys(keys.data(), keys.size()); }
+    size_type export_values(std::span<T> values) const { return export_values(values.data(), values.size()); }
+
+    // Exports the items with keys in the range [low, high), at most as many items,
+    // as fits into both spans (empty span is not filled).
+    size_type export_range(const Key& low, const Key& high, std::span<Key> keys, std::span<T> values) const
+    {
+        const size_type capacity = keys.empty() ? values.size() : (values.empty() ? keys.size() : std::min(keys.size(), values.size()));
+        return export_range(low, high, keys.empty() ? nullptr : keys.data(), values.empty() ? nullptr : values.data(), capacity);
+    }
+#endif
+
     inline key_compare key_comp() const { return _comp; }
     inline value_compare value_comp() const { return value_compare(_comp); }
 
@@ -793,225 +1610,275 @@ public:
     static constexpr unsigned long long memory_consumption_empty() { return sizeof(splay_map); }
     static constexpr unsigned long long memory_consumption_item() { return sizeof(node); }
 
-    // Estimates overall memory consumption
-    constexpr unsigned long long memory_consumption(unsigned long long additional_item_memory = 0) const { return memory_consumption_empty() + _size * (memory_consumption_item() + additional_item_memory); }
+    // Estimates overall memory consumption (allocators tracking their usage report their real usage)
+    unsigned long long memory_consumption(unsigned long long additional_item_memory = 0) const
+    {
+        if (allocator_memory_usage<NodeAllocator>::is_tracked)
+        {
+            return memory_consumption_empty() + allocator_memory_usage<NodeAllocator>::usage(_alloc) + _size * additional_item_memory;
+        }
+
+        return memory_consumption_empty() + _size * (memory_consumption_item() + additional_item_memory);
+    }
 
 private:
+    // Selects search functions specialized for integral keys, if they can be used
+    typedef std::integral_constant<bool, is_integral_key_compare<Key, Compare>::value> integral_search;
+
+    // Selects prefetching of the nodes ahead of the search and iteration
+    typedef std::integral_constant<bool, impl::policy_prefetch<Policy>::value == prefetch_mode::CHILDREN> prefetch_children;
+
+    // Selects the top-down splay during the search for the insertion (the new node
+    // then becomes the root directly, without climbing back up the search path)
+    typedef std::is_same<decltype(Policy::insert_policy), impl::splay_decider<splay_mode::TOP_DOWN>> top_down_insert;
+
+    // Selects the deferred splay of the nodes found by the lookups (found nodes are
+    // queued and splayed in batch, so the lookups between the flushes only read the tree)
+    typedef std::is_same<decltype(Policy::find_policy), impl::splay_decider<splay_mode::DEFERRED>> deferred_find;
+
+    // Selects the erasure of the nodes, splay to the root (default) or unlink in place
+    typedef std::integral_constant<bool, impl::policy_erase<Policy>::value == erase_mode::SPLAY> erase_splay;
+
+    // Selects the lazy erasure, nodes are marked dead and removed later in batch
+    typedef std::integral_constant<bool, impl::policy_erase<Policy>::value == erase_mode::TOMBSTONE> tombstone_erase;
+
+    // We rebind the allocator to allocate nodes
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<node> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> node_traits;
+
+    // Side of the child node, it is used as index to the array of the children,
+    // so the mirrored cases (zig/zag, next/previous) share the same code.
+    enum side : int
+    {
+        LEFT = 0,
+        RIGHT = 1
+    };
+
     // Base node containing only pointers (to the parent/left child/right child),
     // it is used as root of the tree, where parent points to the root of the tree,
     // and left/right pointers points to the min/max value of the tree.
     struct base_node
     {
         base_node* parent;
-        base_node* left;
-        base_node* right;
+        base_node* child[2];
 
         inline node* asNode() { return static_cast<node*>(this); }
         inline const node* asNode() const { return static_cast<const node*>(this); }
     };
 
-    // Rotates the tree node to the right. It does not checks if node/left_child
-    // really exists, so please be careful when calling this function.
-    //
-    //              node                          left_child                *
-    //             /    \                         /         \               *
-    //      left_child  right_child  ==>       ll_child    node             *
-    //       /     \                                      /     \           *
-    //  ll_child  lr_child                             lr_child right_child *
-    inline base_node* _right_rotate(base_node* node) const
-    {
-        base_node* parent = node->parent;
-        base_node* left_child = node->left;
-        base_node* lr_child = left_child->right;
-
-        // Rotate right
-        left_child->right = node;
-        node->parent = left_child;
+    // Returns side of the node (its parent must not be the root of the map)
+    static side _side_of(const base_node* node) { return static_cast<side>(node->parent->child[RIGHT] == node); }
 
-        // Move right grandchild of the left child
-        node->left = lr_child;
-        if (lr_child != &_root)
+    // Sets the parent of the node, if the node exists
+    void _set_parent(base_node* node, base_node* parent) const
+    {
+        if (node != &_root)
         {
-            lr_child->parent = node;
+            node->parent = parent;
         }
+    }
+
+    // Replaces the old child of the parent by the node (parent can be the root,
+    // then the node becomes the root of the tree) and sets the parent of the node.
+    void _attach(base_node* parent, base_node* old_child, base_node* node) const
+    {
+        node->parent = parent;
 
-        // Fix the root
-        left_child->parent = parent;
         if (parent != &_root)
         {
-            if (parent->left == node)
-            {
-                parent->left = left_child;
-            }
-            else
-            {
-                parent->right = left_child;
-            }
+            parent->child[parent->child[RIGHT] == old_child] = node;
         }
         else
         {
             // Mark the new root!
-            _root.parent = left_child;
+            _root.parent = node;
         }
-
-        return left_child;
     }
 
-
-    // Rotates the tree node to the left. It does not checks if node/right_child
-    // really exists, so please be careful when calling this function.
+    // Splays the node to the root. All steps are written for the node on the
+    // side s, the mirrored cases (zig/zag) share the same code, as the side is
+    // used as index to the children. Cases with the node as the left child are shown.
+    //
+    // Zig (parent is the root of the tree):
+    //
+    //              parent                        node                      *
+    //             /      \                      /    \                     *
+    //          node       c       ==>          a    parent                 *
+    //         /    \                                /      \               *
+    //        a      b                              b        c              *
+    //
+    // Zig-zig (node and parent are on the same side):
+    //
+    //                 grand                 node                           *
+    //                /     \               /    \                          *
+    //           parent      d   ==>       a    parent                      *
+    //          /      \                        /      \                    *
+    //       node       c                      b      grand                 *
+    //      /    \                                    /     \               *
+    //     a      b                                  c       d              *
     //
-    //              node                            right_child                *
-    //             /    \                          /         \                 *
-    //      left_child  right_child  ==>         node       rr_child           *
-    //                   /     \                 /   \                         *
-    //              rl_child  rr_child   left_child  rl_child                  *
-    inline base_node* _left_rotate(base_node* node) const
+    // Zig-zag (node and parent are on the opposite sides):
+    //
+    //           grand                           node                       *
+    //          /     \                        /      \                     *
+    //         d     parent      ==>        grand    parent                 *
+    //              /      \                /    \    /     \               *
+    //           node       c              d      a  b       c              *
+    //          /    \                                                      *
+    //         a      b                                                     *
+    void _splay(base_node* node) const
     {
-        base_node* parent = node->parent;
-        base_node* right_child = node->right;
-        base_node* rl_child = right_child->left;
+        while (node->parent != &_root)
+        {
+            base_node* parent = node->parent;
+            base_node* grand = parent->parent;
+            const int s = parent->child[RIGHT] == node;
 
-        // Rotate left
-        right_child->left = node;
-        node->parent = right_child;
+            if (grand == &_root)
+            {
+                // Zig
+                parent->child[s] = node->child[!s];
+                _set_parent(node->child[!s], parent);
+                node->child[!s] = parent;
+                parent->parent = node;
+                _attach(&_root, parent, node);
+                return;
+            }
 
-        // Move left grandchild of the right child
-        node->right = rl_child;
-        if (rl_child != &_root)
-        {
-            rl_child->parent = node;
-        }
+            base_node* great = grand->parent;
 
-        // Fix the root
-        right_child->parent = parent;
-        if (parent != &_root)
-        {
-            if (parent->right == node)
+            if ((grand->child[RIGHT] == parent) == static_cast<bool>(s))
             {
-                parent->right = right_child;
+                // Zig-zig
+                grand->child[s] = parent->child[!s];
+                _set_parent(parent->child[!s], grand);
+                parent->child[!s] = grand;
+                grand->parent = parent;
+
+                parent->child[s] = node->child[!s];
+                _set_parent(node->child[!s], parent);
+                node->child[!s] = parent;
+                parent->parent = node;
             }
             else
             {
-                parent->left = right_child;
+                // Zig-zag
+                parent->child[s] = node->child[!s];
+                _set_parent(node->child[!s], parent);
+                grand->child[!s] = node->child[s];
+                _set_parent(node->child[s], grand);
+
+                node->child[!s] = parent;
+                parent->parent = node;
+                node->child[s] = grand;
+                grand->parent = node;
             }
-        }
-        else
-        {
-            // Mark the new root!
-            _root.parent = right_child;
-        }
 
-        return right_child;
+            _attach(great, grand, node);
+        }
     }
 
-    // Splays the node to the root
-    void _splay(base_node* node) const
+    // Splays the node found by the lookup, if the find policy requires it. In deferred
+    // splay mode, the node is only queued (whole queue is splayed, when it is full).
+    void _splay_found(base_node* node) const
     {
-        while (node->parent != &_root)
+        if (deferred_find::value)
         {
-            if (node->parent->parent == &_root)
-            {
-                // Node level is 1 (so it is directly under the root of the tree)
-                if (node->parent->left == node)
-                {
-                    _right_rotate(node->parent);
-                }
-                else
-                {
-                    _left_rotate(node->parent);
-                }
-            }
-            else
+            if (_splays.push(node))
             {
-                const bool node_is_left_child = node->parent->left == node;
-                const bool node_is_right_child = !node_is_left_child;
-                const bool node_parent_is_left_child = node->parent->parent->left == node->parent;
-                const bool node_parent_is_right_child = !node_parent_is_left_child;
-
-                // Use double rotations when neccessary
-                if (node_is_left_child && node_parent_is_left_child)
-                {
-                    _right_rotate(node->parent->parent);
-                    _right_rotate(node->parent);
-                }
-                else if (node_is_right_child && node_parent_is_right_child)
-                {
-                    _left_rotate(node->parent->parent);
-                    _left_rotate(node->parent);
-                }
-                else if (node_is_left_child && node_parent_is_right_child)
-                {
-                    _right_rotate(node->parent);
-                    _left_rotate(node->parent);
-                }
-                else if (node_is_right_child && node_parent_is_left_child)
-                {
-                    _left_rotate(node->parent);
-                    _right_rotate(node->parent);
-                }
+                flush_splays();
             }
         }
+        else if (_policy.find_policy.splay_hint())
+        {
+            _splay(node);
+        }
     }
 
-    // Destroys the entire tree.
+    // Destroys the entire tree. If the values are trivially destructible and the
+    // allocator releases its memory in bulk, nodes are not visited at all.
     void _cleanup()
     {
-        // First we must linearize tree (so the memory consumption of this object will be constant.
-        base_node* work_node = _root.parent;
+        // Queued nodes are destroyed, they are not splayed
+        _splays.clear();
 
-        while (work_node != &_root)
+        if (!std::is_trivially_destructible<value_type>::value || !allocator_bulk_release<NodeAllocator>::is_bulk(_alloc))
         {
-            // If we have a left child of the current node, rotate the current node right!
-            while (work_node->left != &_root)
-            {
-                work_node = _right_rotate(work_node);
-            }
-
-            // We have no left child. Move to the right in the next layer (linearize the tree).
-            work_node = work_node->right;
+            _destroy_all();
         }
 
-        work_node = _root.parent;
+        // Reinit the map to zero nodes
+        _size = 0;
+        _tombstones = 0;
+        _root.parent = &_root;
+        _root.child[LEFT] = &_root;
+        _root.child[RIGHT] = &_root;
+    }
 
-        while (work_node != &_root)
-        {
-            node* to_destroy = work_node->asNode();
-            work_node = work_node->right;
+    // Destroys all nodes in one pass without rotations. Nodes are destroyed in pre-order
+    // using a small stack, so the children can be prefetched before the node is destroyed.
+    // When the stack is full, the child subtree is destroyed in order (which needs no
+    // memory), so the destruction never allocates. Root is not reinitialized.
+    void _destroy_all()
+    {
+        constexpr std::size_t capacity = 64;
+        base_node* stack[capacity];
+        std::size_t size = 0;
+        impl::null_evictor evictor;
 
-            // Now, we delete the node
-            _orphan_node(to_destroy);
+        if (_root.parent != &_root)
+        {
+            stack[size++] = _root.parent;
         }
 
-        // Reinit the map to zero nodes
-        _size = 0;
-        _root.parent = &_root;
-        _root.left = &_root;
-        _root.right = &_root;
+        while (size > 0)
+        {
+            base_node* current = stack[--size];
+
+            for (base_node* child : { current->child[RIGHT], current->child[LEFT] })
+            {
+                if (child == &_root)
+                {
+                    continue;
+                }
+
+                if (size < capacity)
+                {
+                    impl::prefetch(child);
+                    stack[size++] = child;
+                }
+                else
+                {
+                    _dispose_subtree(child, evictor);
+                }
+            }
+
+            _orphan_node(current);
+        }
     }
 
     // Replants the tree (moves tree to a new root)
     void _replant(base_node* new_root)
     {
-        if (empty())
+        if (_root.parent == &_root)
         {
             // We have nothing to replant... tree is empty
             return;
         }
 
-        base_node* current = _root.left;
+        base_node* current = _root.child[LEFT];
         while (current != &_root)
         {
             base_node* new_current = _next(current);
 
             // Replace "null" pointers
-            if (current->left == &_root)
+            if (current->child[LEFT] == &_root)
             {
-                current->left = new_root;
+                current->child[LEFT] = new_root;
             }
-            if (current->right == &_root)
+            if (current->child[RIGHT] == &_root)
             {
-                current->right = new_root;
+                current->child[RIGHT] = new_root;
             }
 
             current = new_current;
@@ -1027,97 +1894,178 @@ private:
 
         // Empty the current tree
         _root.parent = &_root;
-        _root.left = &_root;
-        _root.right = &_root;
+        _root.child[LEFT] = &_root;
+        _root.child[RIGHT] = &_root;
         _size = 0;
+        _tombstones = 0;
+        _splays.clear();
     }
 
     // Finds the next node in the tree
-    base_node* _next(base_node* node) const
+    base_node* _next(base_node* node) const { return _neighbour(node, RIGHT); }
+
+    // Finds the previous node in the tree
+    base_node* _prev(base_node* node) const { return _neighbour(node, LEFT); }
+
+    // Returns true, if the node (not the root) is dead (erased lazily)
+    static bool _is_tombstone(const base_node* node) { return tombstone_erase::value && node->asNode()->is_dead(); }
+
+    // Returns the first live node from the node in the sorted order (or root)
+    base_node* _skip_tombstones(base_node* node) const
     {
-        if (node == &_root)
+        while (node != &_root && _is_tombstone(node))
         {
-            // "Cyclical" iteration over the range - we return the first node
-            // to ensure the iterators will be valid.
-            return _root.left;
+            node = _next(node);
         }
 
-        if (node->right != &_root)
-        {
-            return _min(node->right);
-        }
-        else
-        {
-            return _first_right_parent_of_node(node);
-        }
+        return node;
     }
 
-    // Finds the previous node in the tree
-    base_node* _prev(base_node* node) const
+    // Removes the minimum or maximum node from the tree, and then the tombstones,
+    // which become the minimum or maximum, so the extremes of the tree are live.
+    void _erase_extreme(base_node* node)
     {
-        if (node == &_root)
+        while (node != &_root)
         {
-            // "Cyclical" iteration over the range - we return the last node
-            // to ensure the iterators will be valid.
-            return _root.right;
+            if (_root.child[LEFT] == node)
+            {
+                _root.child[LEFT] = _next(node);
+            }
+
+            if (_root.child[RIGHT] == node)
+            {
+                _root.child[RIGHT] = _prev(node);
+            }
+
+            if (_is_tombstone(node))
+            {
+                --_tombstones;
+            }
+
+            _unlink_node(node);
+            _orphan_node(node);
+            --_size;
+
+            if (_root.parent == &_root)
+            {
+                break;
+            }
+
+            node = _is_tombstone(_root.child[LEFT]) ? _root.child[LEFT] : (_is_tombstone(_root.child[RIGHT]) ? _root.child[RIGHT] : &_root);
         }
+    }
 
-        if (node->left != &_root)
+    // Removes the tombstones, if the memory for it can be allocated (otherwise
+    // they stay in the tree, until the next attempt)
+    void _compact_tombstones()
+    {
+        try
         {
-            return _max(node->left);
+            compact();
         }
-        else
+        catch (const std::bad_alloc&)
         {
-            return _first_left_parent_of_node(node);
+
         }
     }
 
-    // Finds the node with maximal value in the subtree
-    base_node* _max(base_node* node) const
-    {
-        base_node* last = &_root;
-        do
-        {
-            last = node;
-            node = node->right;
-        } while (node != &_root);
+    // Loads both children of the node to the cache, so the next level of the descent
+    // is being loaded while we are comparing the key of the node. Nil children
+    // point to the root, so no check is needed.
+    static void _prefetch_children(const base_node* node) { _prefetch_children(node, prefetch_children()); }
+    static void _prefetch_children(const base_node* node, std::true_type) { impl::prefetch(node->child[LEFT]); impl::prefetch(node->child[RIGHT]); }
+    static void _prefetch_children(const base_node*, std::false_type) { }
 
-        return last;
-    }
+    // Loads the subtree of the node on the side of iteration, where the neighbour
+    // of the node lies (if the node has the subtree on that side).
+    static void _prefetch_neighbour(const base_node* node, side direction) { _prefetch_neighbour(node, direction, prefetch_children()); }
+    static void _prefetch_neighbour(const base_node* node, side direction, std::true_type) { impl::prefetch(node->child[direction]); }
+    static void _prefetch_neighbour(const base_node*, side, std::false_type) { }
 
-    // Finds the node with minimal value in the subtree
-    base_node* _min(base_node* node) const
+    // Finds the next (direction is RIGHT) or the previous (direction is LEFT) node in the tree
+    base_node* _neighbour(base_node* node, side direction) const
     {
-        base_node* last = &_root;
-        do
+        if (node == &_root)
         {
-            last = node;
-            node = node->left;
-        } while (node != &_root);
+            // "Cyclical" iteration over the range - we return the first (last) node
+            // to ensure the iterators will be valid.
+            return _root.child[!direction];
+        }
 
-        return last;
+        if (node->child[direction] != &_root)
+        {
+            return _extreme(node->child[direction], static_cast<side>(!direction));
+        }
+        else
+        {
+            return _first_parent_of_node(node, direction);
+        }
     }
 
-    // Finds the first right parent of the node
-    base_node* _first_right_parent_of_node(base_node* node) const
+    // Finds the next (direction is RIGHT) or the previous (direction is LEFT) node in the tree
+    // for the iterators, which do not know the map. Root of the map is recognized from the links:
+    // nil child in the direction of the last node in the direction is the root, whose child in
+    // the direction is that last node. It holds also for the root itself, so the root (end)
+    // and the last node both have the neighbour, which is their right child (the root,
+    // resp. the maximum). Child is the real child, if it has the node as parent (nil child
+    // can be the root of the map, whose parent is the root of the tree, but the root of
+    // the tree without the child in the direction is the last node). Neighbour of the first
+    // node in the direction (previous of the first node) is undefined.
+    static base_node* _step(base_node* node, side direction)
     {
-        if (node == &_root)
+        const side opposite = static_cast<side>(!direction);
+        base_node* child = node->child[direction];
+
+        if (child->child[direction] == node)
         {
-            // Node is "end" node, return "end" iterator
-            return &_root;
+            // End of the map, or the last node
+            return node->child[RIGHT];
+        }
+
+        if (child->parent == node)
+        {
+            // Descend to the first node of the subtree in the direction, the nodes
+            // in the subtree are not the root of the tree.
+            while (child->child[opposite]->parent == child)
+            {
+                child = child->child[opposite];
+            }
+
+            return child;
         }
 
-        while (node->parent != &_root && node->parent->right == node)
+        // Climb while we are the child in the direction. The neighbour exists,
+        // so we stop before the root of the map.
+        while (node->parent->child[direction] == node)
         {
-            // While it is right child, go up...
             node = node->parent;
         }
 
         return node->parent;
     }
 
-    // Finds the first left parent of the node
-    base_node* _first_left_parent_of_node(base_node* node) const
+    // Finds the node with maximal value in the subtree
+    base_node* _max(base_node* node) const { return _extreme(node, RIGHT); }
+
+    // Finds the node with minimal value in the subtree
+    base_node* _min(base_node* node) const { return _extreme(node, LEFT); }
+
+    // Finds the last node in the direction in the subtree
+    base_node* _extreme(base_node* node, side direction) const
+    {
+        base_node* last = &_root;
+        do
+        {
+            last = node;
+            node = node->child[direction];
+        } while (node != &_root);
+
+        return last;
+    }
+
+    // Finds the first parent of the node, which has the node in the subtree on
+    // the other side than the direction (first right parent for RIGHT direction)
+    base_node* _first_parent_of_node(base_node* node, side direction) const
     {
         if (node == &_root)
         {
@@ -1125,9 +2073,9 @@ private:
             return &_root;
         }
 
-        while (node->parent != &_root && node->parent->left == node)
+        while (node->parent != &_root && node->parent->child[direction] == node)
         {
-            // While it is left child, go up...
+            // While it is child on the direction side, go up...
             node = node->parent;
         }
 
@@ -1139,22 +2087,63 @@ private:
     {
         base_node* next = _next(node);
 
+        if (tombstone_erase::value)
+        {
+            next = _skip_tombstones(next);
+
+            if (node == _root.child[LEFT] || node == _root.child[RIGHT])
+            {
+                // Minimum and maximum are never dead, so begin() and end() need not
+                // skip the tombstones (erasing from the front stays constant time)
+                _erase_extreme(node);
+                return iterator(next, this);
+            }
+
+            // Mark the node dead, it stays in the tree until the tombstones are
+            // removed, which happens, when they are more than half of the nodes.
+            node->asNode()->set_dead(true);
+
+            if (++_tombstones * 2 > _size)
+            {
+                _compact_tombstones();
+            }
+
+            return iterator(next, this);
+        }
+
         // Fix pointers to the minimum/maximum nodes
-        if (_root.left == node)
+        if (_root.child[LEFT] == node)
+        {
+            _root.child[LEFT] = next;
+        }
+
+        if (_root.child[RIGHT] == node)
         {
-            _root.left = next;
+            _root.child[RIGHT] = _prev(node);
         }
 
-        if (_root.right == node)
+        if (!erase_splay::value)
         {
-            _root.right = _prev(node);
+            // Unlink the node in place, then splay its parent, if we should
+            base_node* parent = node->parent;
+            _unlink_node(node);
+
+            if (impl::policy_erase<Policy>::value == erase_mode::UNLINK_SPLAY_PARENT && parent != &_root)
+            {
+                _splay(parent);
+            }
+
+            _orphan_node(node);
+            --_size;
+
+            return iterator(next, this);
         }
 
         // Splay the node to the root, so we can easily delete it
         _splay(node);
 
-        const bool hasLeftChild = node->left != &_root;
-        const bool hasRightChild = node->right != &_root;
+        const bool hasLeftChild = node->child[LEFT] != &_root;
+        const bool hasRightChild = node->child[RIGHT] != &_root;
 
         // First case, we have single element in the map. Easy...
         if (!hasLeftChild && !hasRightChild)
@@ -1164,7 +2153,7 @@ private:
         else if (hasLeftChild != hasRightChild)
         {
             // We have single child
-            base_node* child = hasLeftChild ? node->left : node->right;
+            base_node* child = node->child[hasRightChild];
             child->parent = &_root;
             _root.parent = child;
         }
@@ -1174,10 +2163,10 @@ private:
             // if we are deleting range, it will be already splayed.
             // First thing we must do, is to decide, if the next node is right
             // child of the node (it is a special case).
-            if (next == node->right)
+            if (next == node->child[RIGHT])
             {
-                next->left = node->left;
-                next->left->parent = next;
+                next->child[LEFT] = node->child[LEFT];
+                next->child[LEFT]->parent = next;
                 next->parent = &_root;
                 _root.parent = next;
             }
@@ -1187,30 +2176,21 @@ private:
                 // left subtree, because it is minimal node.
 
                 // First, detach the right node and attach it to the parent.
-                if (next->parent->left == next)
-                {
-                    // It is a left child...
-                    next->parent->left = next->right;
-                }
-                else
-                {
-                    // It is a right child...
-                    next->parent->right = next->right;
-                }
+                next->parent->child[_side_of(next)] = next->child[RIGHT];
 
-                if (next->right != &_root)
+                if (next->child[RIGHT] != &_root)
                 {
                     // Fix the rights's parent pointer
-                    next->right->parent = next->parent;
+                    next->child[RIGHT]->parent = next->parent;
                 }
 
                 // We must reconnect the next node to the 'old deleted node' position.
                 next->parent = &_root;
                 _root.parent = next;
-                next->left = node->left;
-                node->left->parent = next;
-                next->right = node->right;
-                node->right->parent = next;
+                next->child[LEFT] = node->child[LEFT];
+                node->child[LEFT]->parent = next;
+                next->child[RIGHT] = node->child[RIGHT];
+                node->child[RIGHT]->parent = next;
             }
         }
 
@@ -1227,24 +2207,147 @@ private:
     // key cannot be found, then returns nil and parent, where to insert, otherwise
     // it returns the found node (and parent node has undefined value...).
     base_node* _search_for_insert_hint(const Key& key, base_node** parent)
+    {
+        if (top_down_insert::value)
+        {
+            // Splay the tree around the key during the search, the parent is then the root
+            base_node* found = _top_down_splay(key);
+            *parent = _root.parent;
+            return found;
+        }
+
+        return _search_for_insert_hint(key, parent, integral_search());
+    }
+
+    // Splays the node with the key to the root in one top-down pass (Sleator and Tarjan).
+    // Nodes lower than the key are collected in the left tree, nodes greater than the key
+    // in the right tree, and finally both trees are assembled under the last node of the
+    // search path, which becomes the root. Returns the node with the key, or nil, if the
+    // key is not in the map (then the root is its predecessor or successor). Map must not
+    // be empty. Minimum and maximum of the map are not changed by the splay.
+    base_node* _top_down_splay(const Key& key)
+    {
+        // Header holds the roots of the left tree (as its right child) and the right
+        // tree (as its left child), last[side] is the node of the tree, where the next
+        // node is attached (maximum of the left tree, minimum of the right tree).
+        base_node header;
+        header.child[LEFT] = &_root;
+        header.child[RIGHT] = &_root;
+        base_node* last[2] = { &header, &header };
+
+        base_node* current = _root.parent;
+        bool found = false;
+
+        // Order of the key and the current node (if neither, the key is found). Order
+        // of the key and the child is reused, when the child becomes the current node.
+        _prefetch_children(current);
+        bool lower = _comp(key, current->asNode()->value.first);
+        bool greater = !lower && _comp(current->asNode()->value.first, key);
+
+        for (;;)
+        {
+            if (!lower && !greater)
+            {
+                found = true;
+                break;
+            }
+
+            const side direction = lower ? LEFT : RIGHT;
+            const side opposite = lower ? RIGHT : LEFT;
+
+            base_node* child = current->child[direction];
+            if (child == &_root)
+            {
+                break;
+            }
+
+            _prefetch_children(child);
+            const bool child_lower = _comp(key, child->asNode()->value.first);
+            const bool child_greater = !child_lower && _comp(child->asNode()->value.first, key);
+
+            if (lower ? !child_lower : !child_greater)
+            {
+                // Link the current node to the tree on the opposite side of the key
+                last[opposite]->child[direction] = current;
+                current->parent = last[opposite];
+                last[opposite] = current;
+
+                current = child;
+                lower = child_lower;
+                greater = child_greater;
+                continue;
+            }
+
+            // Zig-zig - rotate the child over the current node
+            current->child[direction] = child->child[opposite];
+            _set_parent(child->child[opposite], current);
+            child->child[opposite] = current;
+            current->parent = child;
+            current = child;
+
+            if (current->child[direction] == &_root)
+            {
+                break;
+            }
+
+            // Link the rotated pair to the tree on the opposite side of the key
+            last[opposite]->child[direction] = current;
+            current->parent = last[opposite];
+            last[opposite] = current;
+
+            current = current->child[direction];
+            _prefetch_children(current);
+            lower = _comp(key, current->asNode()->value.first);
+            greater = !lower && _comp(current->asNode()->value.first, key);
+        }
+
+        // Assemble the trees under the current node
+        last[LEFT]->child[RIGHT] = current->child[LEFT];
+        _set_parent(current->child[LEFT], last[LEFT]);
+        last[RIGHT]->child[LEFT] = current->child[RIGHT];
+        _set_parent(current->child[RIGHT], last[RIGHT]);
+
+        current->child[LEFT] = header.child[RIGHT];
+        _set_parent(current->child[LEFT], current);
+        current->child[RIGHT] = header.child[LEFT];
+        _set_parent(current->child[RIGHT], current);
+
+        current->parent = &_root;
+        _root.parent = current;
+
+        return found ? current : &_root;
+    }
+
+    // Finds the place where to insert the element with particular key (as _search_for_insert_hint),
+    // and the side of the new node (it is valid, if the key cannot be found).
+    base_node* _search_for_insert(const Key& key, base_node** parent, bool* right_child)
+    {
+        base_node* found = _search_for_insert_hint(key, parent);
+        *right_child = found == &_root && _comp((*parent)->asNode()->value.first, key);
+        return found;
+    }
+
+    base_node* _search_for_insert_hint(const Key& key, base_node** parent, std::false_type)
     {
         base_node* current = _root.parent;
         *parent = _root.parent;
 
         while (current != &_root)
         {
+            _prefetch_children(current);
+
             // Set the new parent node
             *parent = current;
 
             if (_comp(key, current->asNode()->value.first))
             {
                 // Key is lesser than value in the current node, walk left
-                current = current->left;
+                current = current->child[LEFT];
             }
             else if (_comp(current->asNode()->value.first, key))
             {
                 // Key is greater than value in the current node, walk right
-                current = current->right;
+                current = current->child[RIGHT];
             }
             else
             {
@@ -1256,32 +2359,208 @@ private:
         return current;
     }
 
+    // Version for integral keys, child node is selected without branching
+    base_node* _search_for_insert_hint(const Key& key, base_node** parent, std::true_type)
+    {
+        base_node* current = _root.parent;
+        *parent = _root.parent;
+
+        while (current != &_root)
+        {
+            _prefetch_children(current);
+
+            const Key current_key = current->asNode()->value.first;
+            if (current_key == key)
+            {
+                break;
+            }
+
+            *parent = current;
+            current = (key < current_key) ? current->child[LEFT] : current->child[RIGHT];
+        }
+
+        return current;
+    }
+
     // Creates a new node with value_type constructed from value. Pointers
-    // to the nodes are uninitialized.
+    // to the nodes are uninitialized. Value is constructed by the allocator,
+    // so allocators supporting uses-allocator construction pass themselves
+    // to the value.
     template<typename... Args>
     base_node* _buy_node(Args&&... args)
     {
-        node* new_node = _alloc.allocate(1);
-        _alloc.construct(new_node, std::forward<Args>(args)...);
+        node* new_node = node_traits::allocate(_alloc, 1);
+        ::new (static_cast<void*>(new_node)) node();
+
+        try
+        {
+            node_traits::construct(_alloc, std::addressof(new_node->value), std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            new_node->~node();
+            node_traits::deallocate(_alloc, new_node, 1);
+            throw;
+        }
+
         return new_node;
     }
 
+    // Detaches all nodes of the tree and destroys their values, returns the chain
+    // of the nodes (linked by the right pointers) for the reuse. Tree is flattened
+    // by right rotations, so no memory is needed. Map is empty after this call.
+    base_node* _harvest_nodes()
+    {
+        base_node* chain = nullptr;
+        base_node* current = _root.parent;
+
+        while (current != &_root)
+        {
+            if (current->child[LEFT] != &_root)
+            {
+                // Rotate the left child up, so we can continue to the left
+                base_node* left = current->child[LEFT];
+                current->child[LEFT] = left->child[RIGHT];
+                left->child[RIGHT] = current;
+                current = left;
+            }
+            else
+            {
+                base_node* next = current->child[RIGHT];
+                node_traits::destroy(_alloc, std::addressof(current->asNode()->value));
+                current->child[RIGHT] = chain;
+                chain = current;
+                current = next;
+            }
+        }
+
+        _size = 0;
+        _tombstones = 0;
+        _splays.clear();
+        _root.parent = &_root;
+        _root.child[LEFT] = &_root;
+        _root.child[RIGHT] = &_root;
+
+        return chain;
+    }
+
+    // Constructs the value in the first node of the chain, if the chain is not empty,
+    // otherwise creates a new node. Pointers of the node are uninitialized.
+    template<typename... Args>
+    base_node* _recycle_node(base_node*& chain, Args&&... args)
+    {
+        if (!chain)
+        {
+            return _buy_node(std::forward<Args>(args)...);
+        }
+
+        base_node* recycled = chain;
+        chain = chain->child[RIGHT];
+        recycled->asNode()->set_dead(false);
+
+        try
+        {
+            node_traits::construct(_alloc, std::addressof(recycled->asNode()->value), std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            recycled->asNode()->~node();
+            node_traits::deallocate(_alloc, recycled->asNode(), 1);
+            throw;
+        }
+
+        return recycled;
+    }
+
+    // Deallocates the nodes of the chain (their values are already destroyed)
+    void _release_chain(base_node* chain)
+    {
+        while (chain)
+        {
+            base_node* next = chain->child[RIGHT];
+            chain->asNode()->~node();
+            node_traits::deallocate(_alloc, chain->asNode(), 1);
+            chain = next;
+        }
+    }
+
+    // Creates new nodes from the range [first, last) and appends them to the nodes.
+    // If the creation of some node fails, all created nodes are destroyed.
+    template<class InputIt>
+    void _buy_nodes(InputIt first, InputIt last, std::vector<base_node*>& nodes)
+    {
+        try
+        {
+            for (; first != last; ++first)
+            {
+                nodes.push_back(_buy_node(*first));
+            }
+        }
+        catch (...)
+        {
+            for (base_node* node : nodes)
+            {
+                _orphan_node(node);
+            }
+            nodes.clear();
+            throw;
+        }
+    }
+
+    // Builds the perfectly balanced subtree from the sorted nodes, returns
+    // root of the subtree (or root of the map, if count is zero).
+    base_node* _build_subtree(base_node* const* nodes, size_type count, base_node* parent)
+    {
+        if (count == 0)
+        {
+            return &_root;
+        }
+
+        const size_type middle = count / 2;
+        base_node* node = nodes[middle];
+        node->parent = parent;
+        node->child[LEFT] = _build_subtree(nodes, middle, node);
+        node->child[RIGHT] = _build_subtree(nodes + middle + 1, count - middle - 1, node);
+        return node;
+    }
+
+    // Rebuilds the whole tree from the sorted nodes. Old tree structure is
+    // forgotten, so all nodes of the old tree must be in the nodes.
+    void _rebuild(const std::vector<base_node*>& nodes)
+    {
+        _size = nodes.size();
+        _tombstones = 0;
+        _splays.clear();
+
+        if (nodes.empty())
+        {
+            _root.parent = &_root;
+            _root.child[LEFT] = &_root;
+            _root.child[RIGHT] = &_root;
+            return;
+        }
+
+        _root.parent = _build_subtree(nodes.data(), nodes.size(), &_root);
+        _root.child[LEFT] = nodes.front();
+        _root.child[RIGHT] = nodes.back();
+    }
+
     // Accesses the element by the key
     template<typename K>
     mapped_type& _access(K&& key)
     {
-        if (empty())
+        if (_root.parent == &_root)
         {
             // Map is empty, we must create a node
             base_node* single_node = _buy_node(std::forward<K>(key), mapped_type());
 
-            _root.left = single_node;
-            _root.right = single_node;
+            _root.child[LEFT] = single_node;
+            _root.child[RIGHT] = single_node;
             _root.parent = single_node;
 
             single_node->parent = &_root;
-            single_node->left = &_root;
-            single_node->right = &_root;
+            single_node->child[LEFT] = &_root;
+            single_node->child[RIGHT] = &_root;
 
             // Increment map size...
             ++_size;
@@ -1303,13 +2582,18 @@ private:
 
                 return new_node->asNode()->value.second;
             }
+            else if (_is_tombstone(found))
+            {
+                // Key was erased, new node takes place of the tombstone
+                base_node* new_node = _buy_node(std::forward<K>(key), mapped_type());
+                _replace_tombstone(found, new_node);
+
+                return new_node->asNode()->value.second;
+            }
             else
             {
                 // Key is already in the map, do nothing (except splaying the node, we assume the find functionality)
-                if (_policy.find_policy.splay_hint())
-                {
-                    _splay(found);
-                }
+                _splay_found(found);
 
                 return found->asNode()->value.second;
             }
@@ -1319,18 +2603,18 @@ private:
     // Inserts new value passed by constant reference
     std::pair<iterator, bool> _insert_by_val(const value_type& value)
     {
-        if (empty())
+        if (_root.parent == &_root)
         {
             // Map is empty, we must create a node
             base_node* single_node = _buy_node(value);
 
-            _root.left = single_node;
-            _root.right = single_node;
+            _root.child[LEFT] = single_node;
+            _root.child[RIGHT] = single_node;
             _root.parent = single_node;
 
             single_node->parent = &_root;
-            single_node->left = &_root;
-            single_node->right = &_root;
+            single_node->child[LEFT] = &_root;
+            single_node->child[RIGHT] = &_root;
 
             // Increment map size...
             ++_size;
@@ -1352,13 +2636,18 @@ private:
 
                 return std::make_pair(iterator(new_node, this), true);
             }
+            else if (_is_tombstone(found))
+            {
+                // Key was erased, new node takes place of the tombstone
+                base_node* new_node = _buy_node(value);
+                _replace_tombstone(found, new_node);
+
+                return std::make_pair(iterator(new_node, this), true);
+            }
             else
             {
                 // Key is already in the map, do nothing (except splaying the node, we assume the find functionality)
-                if (_policy.find_policy.splay_hint())
-                {
-                    _splay(found);
-                }
+                _splay_found(found);
 
                 return std::make_pair(iterator(found, this), false);
             }
@@ -1368,44 +2657,19 @@ private:
     // Inserts a new value passed with constant reference (version with a hint)
     std::pair<iterator, bool> _insert_by_val_hint(const_iterator hint, const value_type& value)
     {
-        if (empty())
+        if (_root.parent == &_root)
         {
             // Use default insertion function in case the map is empty
             return _insert_by_val(value);
         }
 
-        // The first thing we must do is hint validation - we must find out, if the hint
-        // is correct and we can use it. If we cannot, we must use default insertion.
-        // We assume we get iterator BEFORE which we want to insert the value.
-
-        if (hint != cend() && _comp(hint->first, value.first))
-        {
-            // We got an iterator, which is AFTER which we want to insert the value.
-            // Try to increment to get correct hint.
-            ++hint;
-        }
-
-        // Now we must validate the hint (we are trying to insert value immediately before
-        // the place the hint points to). If the hint is not valid, use default insertion
-        // algorithm. We validate iterators (hint - 1, hint), the output valid sequence should
-        // be (hint - 1, value, hint).
-
-        // Left is valid, if it is lesser, than current value (or it does not exists).
-        const_iterator hint_prev = std::prev(hint);
-        const bool leftValid = hint == cbegin() || _comp(hint_prev->first, value.first);
-        const bool rightValid = hint == cend() || _comp(value.first, hint->first);
+        // Find the place for the new node near the hint
+        base_node* parent;
+        bool right_child;
+        base_node* found = _search_for_insert_near(hint._get(), value.first, &parent, &right_child);
 
-        if (leftValid && rightValid)
+        if (found == &_root)
         {
-            // Use hint to create a new node
-            base_node* parent = hint._node;
-            bool right_child = false;
-            if (parent->left != &_root)
-            {
-                parent = hint_prev._node;
-                right_child = true;
-            }
-
             // Key is not in the map, insert it
             base_node* new_node = _buy_node(value);
 
@@ -1414,10 +2678,20 @@ private:
 
             return std::make_pair(iterator(new_node, this), true);
         }
+        else if (_is_tombstone(found))
+        {
+            // Key was erased, new node takes place of the tombstone
+            base_node* new_node = _buy_node(value);
+            _replace_tombstone(found, new_node);
+
+            return std::make_pair(iterator(new_node, this), true);
+        }
         else
         {
-            // The hint is useless (invalid).
-            return _insert_by_val(value);
+            // Key is already in the map, do nothing (except splaying the node, we assume the find functionality)
+            _splay_found(found);
+
+            return std::make_pair(iterator(found, this), false);
         }
     }
 
@@ -1426,37 +2700,108 @@ private:
     // child of the parent (left child if the value of the parameter is false).
     void _insert_node_and_splay(base_node* node, base_node* parent, bool right_child)
     {
-        node->parent = parent;
-        node->left = &_root;
-        node->right = &_root;
-
-        if (right_child)
-        {
+        // If we have to splay on insert, then splay
+        if (_policy.insert_policy.splay_hint())
+        {
+            if (parent == _root.parent)
+            {
+                // Parent is the root (always after the top-down splay), so the node becomes
+                // the root directly - the same result as linking it and one rotation.
+                _link_root(node, parent, right_child);
+            }
+            else
+            {
+                _link_node(node, parent, right_child);
+                _splay(node);
+            }
+        }
+        else
+        {
+            _link_node(node, parent, right_child);
+        }
+    }
+
+    // Links the node into the map as the new root, the old root becomes its child.
+    // The subtree of the old root on the side of the node is moved under the node.
+    void _link_root(base_node* node, base_node* root, bool right_child)
+    {
+        const side direction = right_child ? RIGHT : LEFT;
+        const side opposite = right_child ? LEFT : RIGHT;
+
+        node->child[direction] = root->child[direction];
+        _set_parent(root->child[direction], node);
+        node->child[opposite] = root;
+        root->child[direction] = &_root;
+        root->parent = node;
+
+        node->parent = &_root;
+        _root.parent = node;
+
+        if (node->child[direction] == &_root)
+        {
+            // New minimum (or maximum) in the tree reached, remember it
+            _root.child[direction] = node;
+        }
+
+        // Increment map size...
+        ++_size;
+    }
+
+    // Links the node into the map (as the child of the parent) without splaying.
+    void _link_node(base_node* node, base_node* parent, bool right_child)
+    {
+        node->parent = parent;
+        node->child[LEFT] = &_root;
+        node->child[RIGHT] = &_root;
+
+        if (right_child)
+        {
             // Parent has lower value than new node -> right child
-            parent->right = node;
+            parent->child[RIGHT] = node;
 
-            if (_root.right == parent)
+            if (_root.child[RIGHT] == parent)
             {
                 // new maximum in the tree reached, remember it
-                _root.right = node;
+                _root.child[RIGHT] = node;
             }
         }
         else
         {
             // Parent has higher value than new node -> left child
-            parent->left = node;
+            parent->child[LEFT] = node;
 
-            if (_root.left == parent)
+            if (_root.child[LEFT] == parent)
             {
                 // new minimum in the tree reached, remember it
-                _root.left = node;
+                _root.child[LEFT] = node;
             }
         }
 
         // Increment map size...
         ++_size;
+    }
+
+    // Replaces the tombstone by the new node with the same key (the node takes its place
+    // in the tree), the tombstone is destroyed. Node is splayed as the inserted node.
+    void _replace_tombstone(base_node* tombstone, base_node* node)
+    {
+        node->child[LEFT] = tombstone->child[LEFT];
+        node->child[RIGHT] = tombstone->child[RIGHT];
+        _set_parent(node->child[LEFT], node);
+        _set_parent(node->child[RIGHT], node);
+        _replace_child(tombstone->parent, tombstone, node);
+
+        for (base_node*& extreme : _root.child)
+        {
+            if (extreme == tombstone)
+            {
+                extreme = node;
+            }
+        }
+
+        _orphan_node(tombstone);
+        --_tombstones;
 
-        // If we have to splay on insert, then splay
         if (_policy.insert_policy.splay_hint())
         {
             _splay(node);
@@ -1467,18 +2812,18 @@ private:
     template<typename KeyType, typename... Args>
     std::pair<iterator, bool> _try_emplace_hint(const_iterator hint, bool use_hint, KeyType&& key, Args&&... args)
     {
-        if (empty())
+        if (_root.parent == &_root)
         {
             // Map is empty - it is easy case, just create a new node.
             base_node* node = _buy_node(std::piecewise_construct, std::forward_as_tuple(std::forward<KeyType>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
 
-            _root.left = node;
-            _root.right = node;
+            _root.child[LEFT] = node;
+            _root.child[RIGHT] = node;
             _root.parent = node;
 
             node->parent = &_root;
-            node->left = &_root;
-            node->right = &_root;
+            node->child[LEFT] = &_root;
+            node->child[RIGHT] = &_root;
 
             // Increment map size...
             ++_size;
@@ -1486,54 +2831,10 @@ private:
             return std::make_pair(iterator(node, this), true);
         }
 
-        if (use_hint)
-        {
-            // The first thing we must do is hint validation - we must find out, if the hint
-            // is correct and we can use it. If we cannot, we must use default insertion.
-            // We assume we get iterator BEFORE which we want to insert the value.
-
-            if (hint != cend() && _comp(hint->first, key))
-            {
-                // We got an iterator, which is AFTER which we want to insert the value.
-                // Try to increment to get correct hint.
-                ++hint;
-            }
-
-            // Now we must validate the hint (we are trying to insert value immediately before
-            // the place the hint points to). If the hint is not valid, use default insertion
-            // algorithm. We validate iterators (hint - 1, hint), the output valid sequence should
-            // be (hint - 1, value, hint).
-
-            // Left is valid, if it is lesser, than current value (or it does not exists).
-            const_iterator hint_prev = std::prev(hint);
-            const bool leftValid = hint == cbegin() || _comp(hint_prev->first, key);
-            const bool rightValid = hint == cend() || _comp(key, hint->first);
-
-            if (leftValid && rightValid)
-            {
-                // Use hint to create a new node
-                base_node* parent = hint._node;
-                bool right_child = false;
-                if (parent->left != &_root)
-                {
-                    parent = hint_prev._node;
-                    right_child = true;
-                }
-
-                // Create a new node
-                base_node* node = _buy_node(std::piecewise_construct, std::forward_as_tuple(std::forward<KeyType>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
-
-                // Insert the node and splay it, if necessary
-                _insert_node_and_splay(node, parent, right_child);
-
-                return std::make_pair(iterator(node, this), true);
-            }
-        }
-
-        // The hint was useless (or we did not receive the hint...), perform
-        // standard search and insertion algorithm.
+        // Find the place for the new node (near the hint, if we have received it)
         base_node* parent;
-        base_node* found = _search_for_insert_hint(key, &parent);
+        bool right_child;
+        base_node* found = use_hint ? _search_for_insert_near(hint._get(), key, &parent, &right_child) : _search_for_insert(key, &parent, &right_child);
 
         if (found == &_root)
         {
@@ -1541,7 +2842,15 @@ private:
             base_node* node = _buy_node(std::piecewise_construct, std::forward_as_tuple(std::forward<KeyType>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
 
             // Insert the node and splay it, if necessary
-            _insert_node_and_splay(node, parent, _comp(parent->asNode()->value.first, node->asNode()->value.first));
+            _insert_node_and_splay(node, parent, right_child);
+
+            return std::make_pair(iterator(node, this), true);
+        }
+        else if (_is_tombstone(found))
+        {
+            // Key was erased, new node takes place of the tombstone
+            base_node* node = _buy_node(std::piecewise_construct, std::forward_as_tuple(std::forward<KeyType>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+            _replace_tombstone(found, node);
 
             return std::make_pair(iterator(node, this), true);
         }
@@ -1549,10 +2858,7 @@ private:
         {
             // Key is already in the map, try_emplace does not assign a value, so we just return the value (and splay the node,
             // if neccessary)
-            if (_policy.find_policy.splay_hint())
-            {
-                _splay(found);
-            }
+            _splay_found(found);
 
             return std::make_pair(iterator(found, this), false);
         }
@@ -1563,18 +2869,18 @@ private:
     template<typename KeyType, typename Value>
     std::pair<iterator, bool> _insert_or_assign_hint(const_iterator hint, bool use_hint, KeyType&& key, Value&& value)
     {
-        if (empty())
+        if (_root.parent == &_root)
         {
             // Map is empty - it is easy case, just create a new node.
             base_node* node = _buy_node(std::forward<KeyType>(key), std::forward<Value>(value));
 
-            _root.left = node;
-            _root.right = node;
+            _root.child[LEFT] = node;
+            _root.child[RIGHT] = node;
             _root.parent = node;
 
             node->parent = &_root;
-            node->left = &_root;
-            node->right = &_root;
+            node->child[LEFT] = &_root;
+            node->child[RIGHT] = &_root;
 
             // Increment map size...
             ++_size;
@@ -1582,54 +2888,10 @@ private:
             return std::make_pair(iterator(node, this), true);
         }
 
-        if (use_hint)
-        {
-            // The first thing we must do is hint validation - we must find out, if the hint
-            // is correct and we can use it. If we cannot, we must use default insertion.
-            // We assume we get iterator BEFORE which we want to insert the value.
-
-            if (hint != cend() && _comp(hint->first, key))
-            {
-                // We got an iterator, which is AFTER which we want to insert the value.
-                // Try to increment to get correct hint.
-                ++hint;
-            }
-
-            // Now we must validate the hint (we are trying to insert value immediately before
-            // the place the hint points to). If the hint is not valid, use default insertion
-            // algorithm. We validate iterators (hint - 1, hint), the output valid sequence should
-            // be (hint - 1, value, hint).
-
-            // Left is valid, if it is lesser, than current value (or it does not exists).
-            const_iterator hint_prev = std::prev(hint);
-            const bool leftValid = hint == cbegin() || _comp(hint_prev->first, key);
-            const bool rightValid = hint == cend() || _comp(key, hint->first);
-
-            if (leftValid && rightValid)
-            {
-                // Use hint to create a new node
-                base_node* parent = hint._node;
-                bool right_child = false;
-                if (parent->left != &_root)
-                {
-                    parent = hint_prev._node;
-                    right_child = true;
-                }
-
-                // Create a new node
-                base_node* node = _buy_node(std::forward<KeyType>(key), std::forward<Value>(value));
-
-                // Insert the node and splay it, if necessary
-                _insert_node_and_splay(node, parent, right_child);
-
-                return std::make_pair(iterator(node, this), true);
-            }
-        }
-
-        // The hint was useless (or we did not receive the hint...), perform
-        // standard search and insertion algorithm.
+        // Find the place for the new node (near the hint, if we have received it)
         base_node* parent;
-        base_node* found = _search_for_insert_hint(key, &parent);
+        bool right_child;
+        base_node* found = use_hint ? _search_for_insert_near(hint._get(), key, &parent, &right_child) : _search_for_insert(key, &parent, &right_child);
 
         if (found == &_root)
         {
@@ -1637,21 +2899,32 @@ private:
             base_node* node = _buy_node(std::forward<KeyType>(key), std::forward<Value>(value));
 
             // Insert the node and splay it, if necessary
-            _insert_node_and_splay(node, parent, _comp(parent->asNode()->value.first, node->asNode()->value.first));
+            _insert_node_and_splay(node, parent, right_child);
 
             return std::make_pair(iterator(node, this), true);
         }
-        else
+        else if (_is_tombstone(found))
         {
-            // Key is already in the map, we must assign a new value
+            // Key was erased, we assign the new value and revive the node
             found->asNode()->value.second = std::forward<Value>(value);
+            found->asNode()->set_dead(false);
+            --_tombstones;
 
-            // Find mode - splay the node
-            if (_policy.find_policy.splay_hint())
+            if (_policy.insert_policy.splay_hint())
             {
                 _splay(found);
             }
 
+            return std::make_pair(iterator(found, this), true);
+        }
+        else
+        {
+            // Key is already in the map, we must assign a new value
+            found->asNode()->value.second = std::forward<Value>(value);
+
+            // Find mode - splay the node
+            _splay_found(found);
+
             return std::make_pair(iterator(found, this), false);
         }
     }
@@ -1665,18 +2938,23 @@ private:
         // the new node is deallocated. We assume, that if we use this function, we are
         // very often successfull, so deallocation occurs in not so many cases, so it is
         // not a performance problem.
-        base_node* node = _buy_node(std::forward<Args>(args)...);
+        return _emplace_node_hint(hint, use_hint, _buy_node(std::forward<Args>(args)...));
+    }
 
-        if (empty())
+    // Inserts the created node (with hint or with no hint), if its key is not in the map,
+    // otherwise the node is destroyed.
+    std::pair<iterator, bool> _emplace_node_hint(const_iterator hint, bool use_hint, base_node* node)
+    {
+        if (_root.parent == &_root)
         {
             // Map is empty - it is easy case, just move pointers.
-            _root.left = node;
-            _root.right = node;
+            _root.child[LEFT] = node;
+            _root.child[RIGHT] = node;
             _root.parent = node;
 
             node->parent = &_root;
-            node->left = &_root;
-            node->right = &_root;
+            node->child[LEFT] = &_root;
+            node->child[RIGHT] = &_root;
 
             // Increment map size...
             ++_size;
@@ -1687,56 +2965,22 @@ private:
         // Temporary store reference to the value
         const value_type& value = node->asNode()->value;
 
-        if (use_hint)
-        {
-            // The first thing we must do is hint validation - we must find out, if the hint
-            // is correct and we can use it. If we cannot, we must use default insertion.
-            // We assume we get iterator BEFORE which we want to insert the value.
-
-            if (hint != cend() && _comp(hint->first, value.first))
-            {
-                // We got an iterator, which is AFTER which we want to insert the value.
-                // Try to increment to get correct hint.
-                ++hint;
-            }
-
-            // Now we must validate the hint (we are trying to insert value immediately before
-            // the place the hint points to). If the hint is not valid, use default insertion
-            // algorithm. We validate iterators (hint - 1, hint), the output valid sequence should
-            // be (hint - 1, value, hint).
-
-            // Left is valid, if it is lesser, than current value (or it does not exists).
-            const_iterator hint_prev = std::prev(hint);
-            const bool leftValid = hint == cbegin() || _comp(hint_prev->first, value.first);
-            const bool rightValid = hint == cend() || _comp(value.first, hint->first);
-
-            if (leftValid && rightValid)
-            {
-                // Use hint to create a new node
-                base_node* parent = hint._node;
-                bool right_child = false;
-                if (parent->left != &_root)
-                {
-                    parent = hint_prev._node;
-                    right_child = true;
-                }
-
-                // Insert the node and splay it, if necessary
-                _insert_node_and_splay(node, parent, right_child);
-
-                return std::make_pair(iterator(node, this), true);
-            }
-        }
-
-        // The hint was useless (or we did not receive the hint...), perform
-        // standard search and insertion algorithm.
+        // Find the place for the new node (near the hint, if we have received it)
         base_node* parent;
-        base_node* found = _search_for_insert_hint(value.first, &parent);
+        bool right_child;
+        base_node* found = use_hint ? _search_for_insert_near(hint._get(), value.first, &parent, &right_child) : _search_for_insert(value.first, &parent, &right_child);
 
         if (found == &_root)
         {
             // Insert the node and splay it, if necessary
-            _insert_node_and_splay(node, parent, _comp(parent->asNode()->value.first, node->asNode()->value.first));
+            _insert_node_and_splay(node, parent, right_child);
+
+            return std::make_pair(iterator(node, this), true);
+        }
+        else if (_is_tombstone(found))
+        {
+            // Key was erased, new node takes place of the tombstone
+            _replace_tombstone(found, node);
 
             return std::make_pair(iterator(node, this), true);
         }
@@ -1746,10 +2990,7 @@ private:
             _orphan_node(node);
 
             // splay the node if neccessary
-            if (_policy.find_policy.splay_hint())
-            {
-                _splay(found);
-            }
+            _splay_found(found);
 
             return std::make_pair(iterator(found, this), false);
         }
@@ -1759,36 +3000,75 @@ private:
     // using default allocator.
     void _orphan_node(base_node* node)
     {
-        _alloc.destroy(node->asNode());
-        _alloc.deallocate(node->asNode(), 1);
+        _splays.remove(node);
+        node_traits::destroy(_alloc, std::addressof(node->asNode()->value));
+        node->asNode()->~node();
+        node_traits::deallocate(_alloc, node->asNode(), 1);
+    }
+
+    // Assigns the allocator of the other map, if the propagation is required
+    // (allocators, which must not be propagated, need not be assignable).
+    void _propagate_allocator(const NodeAllocator& alloc, std::true_type) { _alloc = alloc; }
+    void _propagate_allocator(const NodeAllocator&, std::false_type) { }
+    void _propagate_allocator(NodeAllocator&& alloc, std::true_type) { _alloc = std::move(alloc); }
+    void _propagate_allocator(NodeAllocator&&, std::false_type) { }
+
+    // Moves the elements of the other map (using different allocator) to this
+    // map one by one, the other map is cleared.
+    void _move_elements(splay_map& other)
+    {
+        for (value_type& value : other)
+        {
+            emplace_hint(cend(), value.first, std::move(value.second));
+        }
+
+        other.clear();
     }
 
     // Finds the node with this key, returns root, if the node
     // with that key cannot be found.
     base_node* _find(const Key& key) const
+    {
+        base_node* current = _find_node(key, integral_search());
+
+        if (current != &_root && _is_tombstone(current))
+        {
+            // Key was erased
+            return &_root;
+        }
+
+        // If we have found the node, splay it to the root, if neccessary.
+        if (current != &_root)
+        {
+            _splay_found(current);
+        }
+
+        return current;
+    }
+
+    // Finds the node with this key without splaying, returns root, if the node
+    // with that key cannot be found.
+    base_node* _find_node(const Key& key, std::false_type) const
     {
         base_node* current = _root.parent;
 
         while (current != &_root)
         {
+            _prefetch_children(current);
+
             if (_comp(key, current->asNode()->value.first))
             {
                 // Key is lesser than value in the current node, walk left
-                current = current->left;
+                current = current->child[LEFT];
             }
             else if (_comp(current->asNode()->value.first, key))
             {
                 // Key is greater than value in the current node, walk right
-                current = current->right;
+                current = current->child[RIGHT];
             }
             else
             {
-                // Key is equal, we have found the node! Splay it to the root, if neccessary.
-                if (_policy.find_policy.splay_hint())
-                {
-                    _splay(current);
-                }
-
+                // Key is equal, we have found the node!
                 break;
             }
         }
@@ -1796,62 +3076,100 @@ private:
         return current;
     }
 
-    // Finds the lower bound for particular key - first value, that is not less than key,
-    // (so it is equal to the key or greater).
-    base_node* _lower_bound(const Key& key) const
+    // Version for integral keys, child node is selected without branching
+    base_node* _find_node(const Key& key, std::true_type) const
     {
         base_node* current = _root.parent;
-        base_node* candidate = &_root;
 
         while (current != &_root)
         {
-            if (_comp(current->asNode()->value.first, key)) // node is lesser than key
-            {
-                // Value is lesser - go right
-                current = current->right;
-            }
-            else
+            _prefetch_children(current);
+
+            const Key current_key = current->asNode()->value.first;
+            if (current_key == key)
             {
-                // Value is greater or equal - go left and remember the new candidate for lower bound
-                candidate = current;
-                current = current->left;
+                break;
             }
+
+            current = (key < current_key) ? current->child[LEFT] : current->child[RIGHT];
         }
 
-        if (candidate != &_root && _policy.find_policy.splay_hint())
+        return current;
+    }
+
+    // Finds the lower bound for particular key - first value, that is not less than key,
+    // (so it is equal to the key or greater).
+    base_node* _lower_bound(const Key& key) const
+    {
+        base_node* candidate = _skip_tombstones(_lower_bound_node(key));
+
+        if (candidate != &_root)
         {
             // Splay the node, if we should splay it (behave like find)
-            _splay(candidate);
+            _splay_found(candidate);
         }
 
         return candidate;
     }
 
-    // Finds the upper bound for particular key - first value, that is greater than key,
-    base_node* _upper_bound(const Key& key) const
+    // Finds the lower bound for particular key, searching outward from the hint node.
+    // End of the map (or the invalid hint) starts the search from the maximum.
+    base_node* _lower_bound(base_node* hint, const Key& key) const
     {
-        base_node* current = _root.parent;
-        base_node* candidate = &_root;
+        base_node* candidate = _skip_tombstones(_hinted_lower_bound_node(hint, key));
 
-        while (current != &_root)
+        if (candidate != &_root)
         {
-            if (_comp(key, current->asNode()->value.first))
-            {
-                // Value is greater, remember it and go left
-                candidate = current;
-                current = current->left;
-            }
-            else
+            // Splay the node, if we should splay it (behave like find)
+            _splay_found(candidate);
+        }
+
+        return candidate;
+    }
+
+    // Finds the node with this key, searching outward from the hint node,
+    // returns root, if the node with that key cannot be found.
+    base_node* _find(base_node* hint, const Key& key) const
+    {
+        base_node* candidate = _hinted_lower_bound_node(hint, key);
+
+        if (candidate == &_root || _comp(key, candidate->asNode()->value.first) || _is_tombstone(candidate))
+        {
+            return &_root;
+        }
+
+        _splay_found(candidate);
+
+        return candidate;
+    }
+
+    // Finds the lower bound for particular key without splaying, searching outward
+    // from the hint node.
+    base_node* _hinted_lower_bound_node(base_node* hint, const Key& key) const
+    {
+        if (hint == nullptr || hint == &_root)
+        {
+            // Search from the maximum, if the map is not empty
+            hint = _root.child[RIGHT];
+
+            if (hint == &_root)
             {
-                // Value is lesser or equal - go right
-                current = current->right;
+                return &_root;
             }
         }
 
-        if (candidate != &_root && _policy.find_policy.splay_hint())
+        return _finger_lower_bound(hint, key);
+    }
+
+    // Finds the upper bound for particular key - first value, that is greater than key,
+    base_node* _upper_bound(const Key& key) const
+    {
+        base_node* candidate = _skip_tombstones(_upper_bound_node(key));
+
+        if (candidate != &_root)
         {
             // Splay the node, if we should splay it (behave like find)
-            _splay(candidate);
+            _splay_found(candidate);
         }
 
         return candidate;
@@ -1867,24 +3185,29 @@ private:
 
         while (current != &_root)
         {
+            _prefetch_children(current);
+
             if (_comp(key, current->asNode()->value.first))
             {
                 // Key is lesser than value in the current node, walk left
-                current = current->left;
+                current = current->child[LEFT];
             }
             else if (_comp(current->asNode()->value.first, key))
             {
                 // Key is greater than value in the current node, walk right
-                current = current->right;
+                current = current->child[RIGHT];
             }
             else
             {
-                // Key is equal, we have found the node! Splay it to the root, if neccessary.
-                if (_policy.find_policy.splay_hint())
+                if (_is_tombstone(current))
                 {
-                    _splay(current);
+                    // Key was erased
+                    return &_root;
                 }
 
+                // Key is equal, we have found the node! Splay it to the root, if neccessary.
+                _splay_found(current);
+
                 break;
             }
         }
@@ -1897,75 +3220,557 @@ private:
     // of different type.
     template<class K>
     base_node* _lower_bound(const K& key) const
+    {
+        base_node* candidate = _skip_tombstones(_lower_bound_node(key));
+
+        if (candidate != &_root)
+        {
+            // Splay the node, if we should splay it (behave like find)
+            _splay_found(candidate);
+        }
+
+        return candidate;
+    }
+
+    // Finds the upper bound for particular key - first value, that is greater than key.
+    // Template version, key can be of different type.
+    template<class K>
+    base_node* _upper_bound(const K& key) const
     {
         base_node* current = _root.parent;
         base_node* candidate = &_root;
 
         while (current != &_root)
         {
-            if (_comp(current->asNode()->value.first, key)) // node is lesser than key
+            _prefetch_children(current);
+
+            if (_comp(key, current->asNode()->value.first))
             {
-                // Value is lesser - go right
-                current = current->right;
+                // Value is greater, remember it and go left
+                candidate = current;
+                current = current->child[LEFT];
             }
             else
             {
-                // Value is greater or equal - go left and remember the new candidate for lower bound
-                candidate = current;
-                current = current->left;
+                // Value is lesser or equal - go right
+                current = current->child[RIGHT];
             }
         }
 
-        if (candidate != &_root && _policy.find_policy.splay_hint())
+        candidate = _skip_tombstones(candidate);
+
+        if (candidate != &_root)
         {
             // Splay the node, if we should splay it (behave like find)
-            _splay(candidate);
+            _splay_found(candidate);
         }
 
         return candidate;
     }
 
-    // Finds the upper bound for particular key - first value, that is greater than key.
-    // Template version, key can be of different type.
+    // Finds the lower bound for particular key without splaying - first node,
+    // that is not less than key. Returns root, if there is no such node.
     template<class K>
-    base_node* _upper_bound(const K& key) const
+    base_node* _lower_bound_node(const K& key) const
     {
         base_node* current = _root.parent;
         base_node* candidate = &_root;
 
         while (current != &_root)
         {
+            _prefetch_children(current);
+
+            if (_comp(current->asNode()->value.first, key)) // node is lesser than key
+            {
+                // Value is lesser - go right
+                current = current->child[RIGHT];
+            }
+            else
+            {
+                // Value is greater or equal - go left and remember the new candidate for lower bound
+                candidate = current;
+                current = current->child[LEFT];
+            }
+        }
+
+        return candidate;
+    }
+
+    // Finds the upper bound for particular key without splaying - first node,
+    // that is greater than key. Returns root, if there is no such node.
+    base_node* _upper_bound_node(const Key& key) const
+    {
+        base_node* current = _root.parent;
+        base_node* candidate = &_root;
+
+        while (current != &_root)
+        {
+            _prefetch_children(current);
+
             if (_comp(key, current->asNode()->value.first))
             {
                 // Value is greater, remember it and go left
                 candidate = current;
-                current = current->left;
+                current = current->child[LEFT];
             }
             else
             {
                 // Value is lesser or equal - go right
-                current = current->right;
+                current = current->child[RIGHT];
             }
         }
 
-        if (candidate != &_root && _policy.find_policy.splay_hint())
+        return candidate;
+    }
+
+    // Finds the last node, which is not greater than key, without splaying.
+    // Returns root, if there is no such node.
+    template<class K>
+    base_node* _floor_node(const K& key) const
+    {
+        base_node* current = _root.parent;
+        base_node* candidate = &_root;
+
+        while (current != &_root)
         {
-            // Splay the node, if we should splay it (behave like find)
-            _splay(candidate);
+            _prefetch_children(current);
+
+            if (_comp(key, current->asNode()->value.first))
+            {
+                // Value is greater - go left
+                current = current->child[LEFT];
+            }
+            else
+            {
+                // Value is lesser or equal - remember the new candidate and go right
+                candidate = current;
+                current = current->child[RIGHT];
+            }
         }
 
         return candidate;
     }
 
-    // Ordinary node containing data
-    struct node : public base_node
+    // Finds the lower bound for particular key without splaying, searching outward from
+    // the finger node. We climb up to the lowest ancestor, whose subtree must contain
+    // the lower bound (or the root), and then we descend. Finger must be valid node
+    // of the tree (it can't be root).
+    template<class K>
+    base_node* _finger_lower_bound(base_node* finger, const K& key) const
     {
-        template<typename... Args>
-        explicit node(Args&&... args) : value(std::forward<Args>(args)...) { }
+        base_node* candidate = &_root;
+        base_node* current = _finger_climb(finger, key, &candidate);
+
+        // Now descend in the subtree of the current node
+        while (current != &_root)
+        {
+            _prefetch_children(current);
+
+            if (_comp(current->asNode()->value.first, key))
+            {
+                // Value is lesser - go right
+                current = current->child[RIGHT];
+            }
+            else
+            {
+                // Value is greater or equal - go left and remember the new candidate for lower bound
+                candidate = current;
+                current = current->child[LEFT];
+            }
+        }
+
+        return candidate;
+    }
+
+    // Finds the place where to insert the element with particular key, searching outward
+    // from the finger node (as _finger_lower_bound). If the key is in the map, returns
+    // its node, otherwise returns root and the parent and side of the new node.
+    template<class K>
+    base_node* _finger_search_for_insert(base_node* finger, const K& key, base_node** parent, bool* right_child) const
+    {
+        base_node* candidate = &_root;
+        base_node* current = _finger_climb(finger, key, &candidate);
+
+        if (current == &_root || (candidate != &_root && !_comp(key, candidate->asNode()->value.first)))
+        {
+            // Finger, or the upper bound of the subtree (it is not lesser than key) is equal to the key
+            return candidate;
+        }
+
+        while (current != &_root)
+        {
+            _prefetch_children(current);
+            *parent = current;
+
+            if (_comp(key, current->asNode()->value.first))
+            {
+                *right_child = false;
+                current = current->child[LEFT];
+            }
+            else if (_comp(current->asNode()->value.first, key))
+            {
+                *right_child = true;
+                current = current->child[RIGHT];
+            }
+            else
+            {
+                // We have found the node
+                return current;
+            }
+        }
+
+        return &_root;
+    }
+
+    // Finds the place where to insert the element with particular key near the hint (node,
+    // before or after which the key belongs, or the end). Correct hints are validated in O(1)
+    // by local pointer checks - the neighbour of the hint on the side of the key is checked,
+    // if it is the parent or the child of the hint. Otherwise, the place is found by the finger
+    // search from the hint. If the key is in the map, returns its node, otherwise returns root
+    // and the parent and side of the new node. Map must not be empty.
+    template<class K>
+    base_node* _search_for_insert_near(base_node* hint, const K& key, base_node** parent, bool* right_child) const
+    {
+        if (hint == &_root)
+        {
+            // Hint is the end, key must be greater than the maximum
+            hint = _root.child[RIGHT];
+
+            if (_comp(hint->asNode()->value.first, key))
+            {
+                *parent = hint;
+                *right_child = true;
+                return &_root;
+            }
+        }
+        else
+        {
+            const bool lesser = _comp(key, hint->asNode()->value.first);
+            if (!lesser && !_comp(hint->asNode()->value.first, key))
+            {
+                // Hint is equal to the key
+                return hint;
+            }
+
+            // Key belongs on the direction side of the hint, it must be between the hint and its
+            // neighbour on that side (predecessor for LEFT, successor for RIGHT).
+            const side direction = lesser ? LEFT : RIGHT;
+            const side opposite = static_cast<side>(!direction);
+            base_node* child = hint->child[direction];
+
+            if (child == &_root)
+            {
+                // Neighbour is the parent, if we are its child from the opposite side.
+                // The extreme node has no neighbour.
+                base_node* hint_parent = hint->parent;
+                if (_root.child[direction] == hint ||
+                    (hint_parent != &_root && hint_parent->child[opposite] == hint && _is_beyond(hint_parent, key, direction)))
+                {
+                    *parent = hint;
+                    *right_child = direction == RIGHT;
+                    return &_root;
+                }
+            }
+            else if (child->child[opposite] == &_root && _is_beyond(child, key, direction))
+            {
+                // Neighbour is the child, key belongs between the hint and the child
+                *parent = child;
+                *right_child = opposite == RIGHT;
+                return &_root;
+            }
+        }
+
+        return _finger_search_for_insert(hint, key, parent, right_child);
+    }
+
+    // Returns true, if the node lies beyond the key in the direction (node is greater
+    // than key for RIGHT, lesser than key for LEFT).
+    template<class K>
+    bool _is_beyond(const base_node* node, const K& key, side direction) const
+    {
+        return direction == RIGHT ? _comp(key, node->asNode()->value.first) : _comp(node->asNode()->value.first, key);
+    }
+
+    // Climbs from the finger node to the lowest ancestor, whose subtree must contain the
+    // lower bound of the key, and returns it. Candidate is set to the upper bound of that
+    // subtree (root, if there is no such node). If the finger is equal to the key, then
+    // returns root and candidate is set to the finger.
+    template<class K>
+    base_node* _finger_climb(base_node* finger, const K& key, base_node** candidate) const
+    {
+        base_node* current = finger;
+
+        if (_comp(current->asNode()->value.first, key))
+        {
+            // Finger is lesser than key, we must climb up until we find a parent, for which
+            // we are in the left subtree and which is not lesser than key. That parent is
+            // the candidate for lower bound, and it is the upper bound of our subtree.
+            while (current->parent != &_root)
+            {
+                base_node* parent = current->parent;
+                if (parent->child[LEFT] == current && !_comp(parent->asNode()->value.first, key))
+                {
+                    *candidate = parent;
+                    break;
+                }
+
+                current = parent;
+            }
+        }
+        else if (!_comp(key, current->asNode()->value.first))
+        {
+            // Finger is equal to the key, we have found it directly
+            *candidate = current;
+            return &_root;
+        }
+        else
+        {
+            // Finger is greater than the key, we must climb up until we find a parent,
+            // for which we are in the right subtree and which is lesser than key. Our
+            // subtree then contains the lower bound (at least finger is the candidate).
+            while (current->parent != &_root)
+            {
+                base_node* parent = current->parent;
+                if (parent->child[RIGHT] == current && _comp(parent->asNode()->value.first, key))
+                {
+                    break;
+                }
+
+                current = parent;
+            }
+        }
 
-        value_type value;
+        return current;
+    }
+
+    // Replaces the child of the parent by a new child (parent can be the root,
+    // then the new child becomes the root of the tree).
+    void _replace_child(base_node* parent, base_node* old_child, base_node* new_child)
+    {
+        if (parent == &_root)
+        {
+            _root.parent = new_child;
+        }
+        else
+        {
+            parent->child[parent->child[RIGHT] == old_child] = new_child;
+        }
+
+        if (new_child != &_root)
+        {
+            new_child->parent = parent;
+        }
+    }
+
+    // Unlinks the node from the tree in place (standard binary search tree deletion,
+    // node with two children is replaced by its successor). It does not splay, does not
+    // destroy the node and does not fix minimum/maximum pointers nor size. Returns
+    // the node, which took place of the unlinked node, or its parent, if the node
+    // was a leaf (the root, if the tree is empty now).
+    base_node* _unlink_node(base_node* node)
+    {
+        base_node* replacement = &_root;
+
+        if (node->child[LEFT] == &_root)
+        {
+            replacement = node->child[RIGHT];
+        }
+        else if (node->child[RIGHT] == &_root)
+        {
+            replacement = node->child[LEFT];
+        }
+        else
+        {
+            // Node has two children, so the successor is minimum of the right subtree
+            // and it hasn't left child.
+            replacement = _min(node->child[RIGHT]);
+
+            if (replacement != node->child[RIGHT])
+            {
+                // Detach the successor and move it to the place of the node
+                replacement->parent->child[LEFT] = replacement->child[RIGHT];
+                if (replacement->child[RIGHT] != &_root)
+                {
+                    replacement->child[RIGHT]->parent = replacement->parent;
+                }
+
+                replacement->child[RIGHT] = node->child[RIGHT];
+                replacement->child[RIGHT]->parent = replacement;
+            }
+
+            replacement->child[LEFT] = node->child[LEFT];
+            replacement->child[LEFT]->parent = replacement;
+        }
+
+        _replace_child(node->parent, node, replacement);
+        return (replacement != &_root) ? replacement : node->parent;
+    }
+
+    // Visits the nodes from the stack in sorted order (in reverse order, if Reverse
+    // is true), until the last node is reached. Top of the stack is the first node
+    // to be visited, and the stack contains all its ancestors, which are visited
+    // after it. Returns false, if the visitor stopped the visitation.
+    template<typename Value, bool Reverse, typename Visitor>
+    bool _visit(impl::node_stack<base_node*>& stack, const base_node* last, Visitor& visitor) const
+    {
+        while (!stack.empty())
+        {
+            base_node* node = stack.pop();
+            if (node == last)
+            {
+                break;
+            }
+
+            // Load the next subtree while the visitor works
+            base_node* far_child = Reverse ? node->child[LEFT] : node->child[RIGHT];
+            impl::prefetch(far_child);
+
+            if (!_is_tombstone(node) && !impl::visit(visitor, static_cast<Value&>(node->asNode()->value)))
+            {
+                return false;
+            }
+
+            for (; far_child != &_root; far_child = Reverse ? far_child->child[RIGHT] : far_child->child[LEFT])
+            {
+                stack.push(far_child);
+            }
+        }
+
+        return true;
+    }
+
+    // Visits all nodes of the tree
+    template<typename Value, bool Reverse, typename Visitor>
+    bool _visit_all(Visitor& visitor) const
+    {
+        impl::node_stack<base_node*> stack;
+
+        for (base_node* node = _root.parent; node != &_root; node = Reverse ? node->child[RIGHT] : node->child[LEFT])
+        {
+            stack.push(node);
+        }
+
+        return _visit<Value, Reverse>(stack, &_root, visitor);
+    }
+
+    // Visits all nodes with keys in the range [low, high)
+    template<typename Value, bool Reverse, typename Visitor>
+    bool _visit_range(const Key& low, const Key& high, Visitor& visitor) const
+    {
+        if (!_comp(low, high))
+        {
+            // Range is empty
+            return true;
+        }
+
+        // Fill the stack with the path to the first visited node (lower bound of low,
+        // or the last node lesser than high in reverse order), only nodes visited
+        // after the first node are stored.
+        impl::node_stack<base_node*> stack;
+        const Key& first_key = Reverse ? high : low;
+
+        for (base_node* node = _root.parent; node != &_root;)
+        {
+            const bool is_lesser = _comp(node->asNode()->value.first, first_key);
+
+            if (is_lesser == Reverse)
+            {
+                stack.push(node);
+            }
+
+            node = is_lesser ? node->child[RIGHT] : node->child[LEFT];
+        }
+
+        // Visitation stops at lower bound of high (or at the last node
+        // lesser than low in reverse order).
+        const base_node* last = Reverse ? _prev(_lower_bound_node(low)) : _lower_bound_node(high);
+        return _visit<Value, Reverse>(stack, last, visitor);
+    }
+
+    // Destroys the detached subtree in one in-order pass, without any rotations. Every
+    // visited node is the leftmost node of the remaining subtree, so it has no left
+    // child and it can be replaced by its right subtree. Evictor is called with each
+    // value (in sorted order) before it is destroyed. Returns count of destroyed nodes.
+    template<class Evictor>
+    size_type _dispose_subtree(base_node* subtree, Evictor& evictor)
+    {
+        size_type count = 0;
+
+        // Detach the subtree from its parent, so we know where to stop
+        subtree->parent = &_root;
+        base_node* current = _min(subtree);
+
+        while (current != &_root)
+        {
+            base_node* parent = current->parent;
+            base_node* right = current->child[RIGHT];
+            base_node* next = parent;
+
+            if (right != &_root)
+            {
+                // Replace current node by its right subtree
+                right->parent = parent;
+                next = _min(right);
+            }
+
+            if (parent != &_root)
+            {
+                // Current node is always the left child of its parent
+                parent->child[LEFT] = right;
+            }
+
+            evictor(current->asNode()->value);
+            _orphan_node(current);
+            ++count;
+
+            current = next;
+        }
+
+        _size -= count;
+        return count;
+    }
+
+    // Destroys all nodes of the tree, evictor is called with each value
+    // before it is destroyed.
+    template<class Evictor>
+    size_type _dispose_all(Evictor& evictor)
+    {
+        size_type count = 0;
+
+        if (_root.parent != &_root)
+        {
+            count = _dispose_subtree(_root.parent, evictor);
+        }
+
+        _root.parent = &_root;
+        _root.child[LEFT] = &_root;
+        _root.child[RIGHT] = &_root;
+        return count;
+    }
+
+    // Alignment of the node, at least the natural alignment of its members
+    static constexpr std::size_t node_align = impl::max_value(impl::policy_alignment<Policy>::value, alignof(base_node), alignof(value_type));
+
+    // Ordinary node containing data. Value is a member of the union, so
+    // it is constructed and destroyed by the allocator, not by the node.
+    // Node is aligned as the policy requires, the allocator must respect
+    // alignment of the node.
+    struct alignas(node_align) node : public base_node, public impl::node_mark<tombstone_erase::value>
+    {
+        node() { }
+        ~node() { }
+
+        union
+        {
+            value_type value;
+        };
     };
 
+#if !defined(__cpp_aligned_new)
+    // Standard allocator does not allocate over-aligned objects before C++17
+    static_assert(node_align <= alignof(std::max_align_t) || !std::is_same<NodeAllocator, std::allocator<node>>::value, "Over-aligned nodes require an allocator respecting the alignment!");
+#endif
+
     // Root of this map, parent points to the root of the tree,
     // left child is minimum of the tree, right child is the maximum
     // of the tree,
@@ -1974,15 +3779,18 @@ private:
     // Key comparator defined by the constructor
     Compare _comp;
 
-    // We rebind the allocator to allocate nodes
-    typedef typename Allocator::template rebind<node>::other NodeAllocator;
-
     // Node allocator
     NodeAllocator _alloc;
 
-    // Actual count of elements in this map
+    // Actual count of nodes in this map (including the tombstones)
     size_type _size;
 
+    // Count of the dead nodes (tombstones) in this map
+    size_type _tombstones;
+
+    // Nodes found by the lookups, which wait for the splay (deferred splay mode)
+    mutable impl::splay_queue<base_node, deferred_find::value> _splays;
+
     // Policy for behaviour of splaying the nodes in this splay tree
     Policy _policy;
 };
@@ -1993,6 +3801,29 @@ template<typename Key,
          typename Allocator = std::allocator<std::pair<const Key, T>>>
 using splay_classic_map = splay_map<Key, T, Compare, Allocator, splay_map_policy<splay_mode::NEVER, splay_mode::ALWAYS>>;
 
+// Splay map with integral keys, it always uses the search functions specialized
+// for integral keys.
+template<typename Key,
+         typename T,
+         typename Allocator = std::allocator<std::pair<const Key, T>>,
+         typename Policy = splay_map_policy<splay_mode::FOURTH, splay_mode::THIRD>>
+using int_splay_map = splay_map<typename std::enable_if<std::is_integral<Key>::value, Key>::type, T, std::less<Key>, Allocator, Policy>;
+
+#ifdef BUSHY_HAS_MEMORY_RESOURCE
+namespace pmr
+{
+
+// Splay map using the polymorphic allocator, so nodes can be allocated from
+// the memory resource (for example, monotonic buffer of the request).
+template<typename Key,
+         typename T,
+         typename Compare = std::less<Key>,
+         typename Policy = splay_map_policy<splay_mode::FOURTH, splay_mode::THIRD>>
+using splay_map = bushy::splay_map<Key, T, Compare, std::pmr::polymorphic_allocator<std::pair<const Key, T>>, Policy>;
+
+}   // namespace pmr
+#endif
+
 }   // namespace bushy
 
 template<class Key, class T, class Compare, class Alloc>
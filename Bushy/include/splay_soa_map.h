@@ -0,0 +1,726 @@
+//**************************** LICENSE *************************************
+//
+// Bushy - various search tree implementation library
+// Copyright (C) 2016  Jakub Melka
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//**************************************************************************
+
+#ifndef BUSHY_SPLAY_SOA_MAP_H
+#define BUSHY_SPLAY_SOA_MAP_H
+
+#include "splay_map.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace bushy
+{
+
+// Splay map with struct-of-arrays layout - the hot part of the nodes (keys and links)
+// and the values are stored in two parallel arrays indexed by the node id (instead of
+// nodes allocated separately in the heap). Links are indices, not pointers, so for
+// small keys the key and the links of the node take only a few bytes, and the search
+// (find, lower_bound, upper_bound) touches only the dense array of the keys and links.
+// The value array is touched only, when the value is dereferenced. The key is stored
+// together with the links, so each level of the search touches only one cache line.
+//
+// Arrays are kept dense: erase moves the last node into the place of the erased
+// node, so the map never contains holes.
+//
+// NOTE: Insertion invalidates references to the keys and values (arrays can be
+// reallocated), iterators remain valid. Erase invalidates iterators and references
+// to the erased element and to the last element in the arrays. Dereference returns
+// pair of references to the key and to the value.
+template<typename Key,
+         typename T,
+         typename Compare = std::less<Key>,
+         typename Policy = splay_map_policy<splay_mode::FOURTH, splay_mode::THIRD>,
+         typename Index = std::uint32_t>
+class splay_soa_map
+{
+    static_assert(std::is_unsigned<Index>::value, "Index must be unsigned integral type!");
+
+public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Compare key_compare;
+    typedef std::pair<const Key&, T&> reference;
+    typedef std::pair<const Key&, const T&> const_reference;
+
+    // Iterator implementation, Const selects the constant iterator. Iterator holds
+    // the index of the node, so it remains valid, when the arrays are reallocated.
+    template<bool Const>
+    class iterator_impl
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef typename splay_soa_map::value_type value_type;
+        typedef typename splay_soa_map::difference_type difference_type;
+        typedef typename std::conditional<Const, const_reference, typename splay_soa_map::reference>::type reference;
+        typedef typename std::conditional<Const, const splay_soa_map*, splay_soa_map*>::type map_pointer;
+
+        // Pointer returned by the arrow operator, holds the pair of references
+        class pointer
+        {
+        public:
+            explicit pointer(reference value) : _value(value) { }
+            reference* operator->() { return &_value; }
+
+        private:
+            reference _value;
+        };
+
+        iterator_impl() : _index(nil), _map(nullptr) { }
+
+        // Conversion constructor from iterator to const iterator
+        template<bool ConstFrom>
+        iterator_impl(const iterator_impl<ConstFrom>& other, typename std::enable_if<Const || !ConstFrom, int>::type = int()) :
+            _index(other._index),
+            _map(other._map)
+        {
+
+        }
+
+        // Dereference operators
+        reference operator*() const { return reference(_map->_nodes[_index].key, _map->_values[_index]); }
+        pointer operator->() const { return pointer(**this); }
+
+        iterator_impl& operator++()
+        {
+            _index = _map->_next(_index);
+            return *this;
+        }
+
+        iterator_impl operator++(int)
+        {
+            iterator_impl temp(*this);
+            ++*this;
+            return temp;
+        }
+
+        iterator_impl& operator--()
+        {
+            _index = (_index != nil) ? _map->_previous(_index) : _map->_max(_map->_root);
+            return *this;
+        }
+
+        iterator_impl operator--(int)
+        {
+            iterator_impl temp(*this);
+            --*this;
+            return temp;
+        }
+
+        template<bool OtherConst>
+        bool operator==(const iterator_impl<OtherConst>& other) const
+        {
+            return _index == other._index;
+        }
+
+        template<bool OtherConst>
+        bool operator!=(const iterator_impl<OtherConst>& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        explicit iterator_impl(Index index, map_pointer map) : _index(index), _map(map) { }
+
+        // To allow use of private members in the map and in the other iterator type
+        friend class splay_soa_map;
+        template<bool> friend class iterator_impl;
+
+        Index _index;
+        map_pointer _map;
+    };
+
+    using iterator = iterator_impl<false>;
+    using const_iterator = iterator_impl<true>;
+
+    // Constructors
+
+    splay_soa_map() : splay_soa_map(Compare()) { }
+
+    explicit splay_soa_map(const Compare& comp) : _root(nil), _comp(comp) { }
+
+    template<class InputIterator>
+    splay_soa_map(InputIterator first, InputIterator last, const Compare& comp = Compare()) : splay_soa_map(comp)
+    {
+        insert(first, last);
+    }
+
+    splay_soa_map(std::initializer_list<value_type> ilist, const Compare& comp = Compare()) : splay_soa_map(ilist.begin(), ilist.end(), comp) { }
+
+    splay_soa_map(const splay_soa_map&) = default;
+
+    splay_soa_map(splay_soa_map&& other) :
+        _nodes(std::move(other._nodes)),
+        _values(std::move(other._values)),
+        _root(other._root),
+        _comp(std::move(other._comp)),
+        _policy(std::move(other._policy))
+    {
+        other.clear();
+    }
+
+    splay_soa_map& operator=(const splay_soa_map&) = default;
+
+    splay_soa_map& operator=(splay_soa_map&& other)
+    {
+        if (&other != this)
+        {
+            _nodes = std::move(other._nodes);
+            _values = std::move(other._values);
+            _root = other._root;
+            _comp = std::move(other._comp);
+            _policy = std::move(other._policy);
+            other.clear();
+        }
+
+        return *this;
+    }
+
+    splay_soa_map& operator=(std::initializer_list<value_type> ilist)
+    {
+        clear();
+        insert(ilist.begin(), ilist.end());
+        return *this;
+    }
+
+    // Element access
+
+    T& at(const Key& key)
+    {
+        const Index index = _find(key);
+
+        if (index != nil)
+        {
+            return _values[index];
+        }
+        else
+        {
+            throw std::out_of_range("bushy::splay_soa_map::at() - key not found!");
+        }
+    }
+
+    const T& at(const Key& key) const
+    {
+        return const_cast<splay_soa_map*>(this)->at(key);
+    }
+
+    T& operator[](const Key& key) { return _values[_try_emplace(key).first]; }
+    T& operator[](Key&& key) { return _values[_try_emplace(std::move(key)).first]; }
+
+    // Iterators
+
+    iterator begin() { return iterator(_min(_root), this); }
+    const_iterator begin() const { return const_iterator(_min(_root), this); }
+    const_iterator cbegin() const { return begin(); }
+
+    iterator end() { return iterator(nil, this); }
+    const_iterator end() const { return const_iterator(nil, this); }
+    const_iterator cend() const { return end(); }
+
+    // Capacity
+
+    bool empty() const { return _nodes.empty(); }
+    size_type size() const { return _nodes.size(); }
+    size_type max_size() const { return nil; }
+
+    // Reserves the memory of the arrays for count elements
+    void reserve(size_type count)
+    {
+        _nodes.reserve(count);
+        _values.reserve(count);
+    }
+
+    // Modifiers
+
+    void clear()
+    {
+        _nodes.clear();
+        _values.clear();
+        _root = nil;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return try_emplace(value.first, value.second); }
+    std::pair<iterator, bool> insert(value_type&& value) { return try_emplace(value.first, std::move(value.second)); }
+
+    template<class InputIt>
+    void insert(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+        {
+            insert(*first);
+        }
+    }
+
+    void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj)
+    {
+        std::pair<iterator, bool> result = try_emplace(key, std::forward<M>(obj));
+
+        if (!result.second)
+        {
+            _values[result.first._index] = std::forward<M>(obj);
+        }
+
+        return result;
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        std::pair<Key, T> value(std::forward<Args>(args)...);
+        return try_emplace(std::move(value.first), std::move(value.second));
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args)
+    {
+        std::pair<Index, bool> result = _try_emplace(key, std::forward<Args>(args)...);
+        return std::make_pair(iterator(result.first, this), result.second);
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args)
+    {
+        std::pair<Index, bool> result = _try_emplace(std::move(key), std::forward<Args>(args)...);
+        return std::make_pair(iterator(result.first, this), result.second);
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        return iterator(_erase(pos._index), this);
+    }
+
+    iterator erase(iterator pos)
+    {
+        return iterator(_erase(pos._index), this);
+    }
+
+    size_type erase(const Key& key)
+    {
+        const Index index = _find(key);
+
+        if (index == nil)
+        {
+            return 0;
+        }
+
+        _erase(index);
+        return 1;
+    }
+
+    void swap(splay_soa_map& other)
+    {
+        splay_soa_map temp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(temp);
+    }
+
+    // Lookup
+
+    size_type count(const Key& key) const { return (_find(key) != nil) ? 1 : 0; }
+
+    iterator find(const Key& key) { return iterator(_find(key), this); }
+    const_iterator find(const Key& key) const { return const_iterator(_find(key), this); }
+
+    iterator lower_bound(const Key& key) { return iterator(_bound(key, false), this); }
+    const_iterator lower_bound(const Key& key) const { return const_iterator(_bound(key, false), this); }
+
+    iterator upper_bound(const Key& key) { return iterator(_bound(key, true), this); }
+    const_iterator upper_bound(const Key& key) const { return const_iterator(_bound(key, true), this); }
+
+    std::pair<iterator, iterator> equal_range(const Key& key) { return std::make_pair(lower_bound(key), upper_bound(key)); }
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const { return std::make_pair(lower_bound(key), upper_bound(key)); }
+
+    // Observers
+
+    key_compare key_comp() const { return _comp; }
+
+    // Memory consumption of the map (including the reserved capacity of the arrays)
+    unsigned long long memory_consumption() const
+    {
+        return sizeof(splay_soa_map) + _nodes.capacity() * sizeof(hot_node) + _values.capacity() * sizeof(T);
+    }
+
+private:
+    static constexpr Index nil = std::numeric_limits<Index>::max();
+
+    // Key and links of the node (nil, if the linked node does not exist)
+    struct hot_node
+    {
+        Key key;
+        Index left;
+        Index right;
+        Index parent;
+    };
+
+    // Finds the node with this key, returns nil, if the node with that
+    // key cannot be found. Found node is splayed, if necessary.
+    Index _find(const Key& key) const
+    {
+        const Index index = _bound(key, false);
+
+        if (index == nil || _comp(key, _nodes[index].key))
+        {
+            return nil;
+        }
+
+        return index;
+    }
+
+    // Returns the first node, which key is not less (upper is false), or
+    // greater (upper is true), than the key. Descent uses only the keys and
+    // the links of the nodes. Found node is splayed, if necessary.
+    Index _bound(const Key& key, bool upper) const
+    {
+        Index result = nil;
+        Index current = _root;
+
+        while (current != nil)
+        {
+            const bool go_left = upper ? _comp(key, _nodes[current].key) : !_comp(_nodes[current].key, key);
+
+            if (go_left)
+            {
+                result = current;
+                current = _nodes[current].left;
+            }
+            else
+            {
+                current = _nodes[current].right;
+            }
+        }
+
+        if (result != nil && _policy.find_policy.splay_hint())
+        {
+            _splay(result);
+        }
+
+        return result;
+    }
+
+    // Inserts the new node, if the key is not in the map. Returns index of the node
+    // with the key and flag, if the insertion took place.
+    template<typename KeyType, typename... Args>
+    std::pair<Index, bool> _try_emplace(KeyType&& key, Args&&... args)
+    {
+        Index parent = nil;
+        Index current = _root;
+        bool right_child = false;
+
+        while (current != nil)
+        {
+            parent = current;
+
+            if (_comp(key, _nodes[current].key))
+            {
+                current = _nodes[current].left;
+                right_child = false;
+            }
+            else if (_comp(_nodes[current].key, key))
+            {
+                current = _nodes[current].right;
+                right_child = true;
+            }
+            else
+            {
+                // Key is already in the map
+                if (_policy.find_policy.splay_hint())
+                {
+                    _splay(current);
+                }
+
+                return std::make_pair(current, false);
+            }
+        }
+
+        if (_nodes.size() >= max_size())
+        {
+            throw std::length_error("bushy::splay_soa_map - too many elements!");
+        }
+
+        // Append the node to the arrays, if some step fails, remove the appended parts
+        const Index index = static_cast<Index>(_nodes.size());
+        _nodes.push_back(hot_node{ std::forward<KeyType>(key), nil, nil, parent });
+        try
+        {
+            _values.emplace_back(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            _nodes.pop_back();
+            throw;
+        }
+
+        // Link the node into the tree
+        if (parent == nil)
+        {
+            _root = index;
+        }
+        else if (right_child)
+        {
+            _nodes[parent].right = index;
+        }
+        else
+        {
+            _nodes[parent].left = index;
+        }
+
+        if (_policy.insert_policy.splay_hint())
+        {
+            _splay(index);
+        }
+
+        return std::make_pair(index, true);
+    }
+
+    // Erases the node, returns the index of the next node (after the erase)
+    Index _erase(Index index)
+    {
+        Index next = _next(index);
+
+        // Unlink the node from the tree
+        const Index left = _nodes[index].left;
+        const Index right = _nodes[index].right;
+        if (left == nil)
+        {
+            _transplant(index, right);
+        }
+        else if (right == nil)
+        {
+            _transplant(index, left);
+        }
+        else
+        {
+            // Node has both children, replace it by its successor (which has no left child)
+            const Index successor = next;
+            if (_nodes[successor].parent != index)
+            {
+                _transplant(successor, _nodes[successor].right);
+                _nodes[successor].right = right;
+                _nodes[right].parent = successor;
+            }
+
+            _transplant(index, successor);
+            _nodes[successor].left = left;
+            _nodes[left].parent = successor;
+        }
+
+        // Move the last node to the free place, so the arrays stay dense
+        const Index last = static_cast<Index>(_nodes.size() - 1);
+        if (index != last)
+        {
+            _nodes[index] = std::move(_nodes[last]);
+            _values[index] = std::move(_values[last]);
+            _relink(last, index);
+
+            if (next == last)
+            {
+                next = index;
+            }
+        }
+
+        _nodes.pop_back();
+        _values.pop_back();
+        return next;
+    }
+
+    // Replaces the subtree of the node by the subtree of the replacement
+    void _transplant(Index index, Index replacement)
+    {
+        const Index parent = _nodes[index].parent;
+        _replace_child(parent, index, replacement);
+
+        if (replacement != nil)
+        {
+            _nodes[replacement].parent = parent;
+        }
+    }
+
+    // Replaces the child of the parent (or the root, if parent is nil)
+    void _replace_child(Index parent, Index child, Index replacement) const
+    {
+        if (parent == nil)
+        {
+            _root = replacement;
+        }
+        else if (_nodes[parent].left == child)
+        {
+            _nodes[parent].left = replacement;
+        }
+        else
+        {
+            _nodes[parent].right = replacement;
+        }
+    }
+
+    // Updates the links pointing to the node, which was moved from index 'from' to index 'to'
+    void _relink(Index from, Index to)
+    {
+        const hot_node& node = _nodes[to];
+        _replace_child(node.parent, from, to);
+
+        if (node.left != nil)
+        {
+            _nodes[node.left].parent = to;
+        }
+
+        if (node.right != nil)
+        {
+            _nodes[node.right].parent = to;
+        }
+    }
+
+    Index _min(Index index) const
+    {
+        if (index != nil)
+        {
+            while (_nodes[index].left != nil)
+            {
+                index = _nodes[index].left;
+            }
+        }
+
+        return index;
+    }
+
+    Index _max(Index index) const
+    {
+        if (index != nil)
+        {
+            while (_nodes[index].right != nil)
+            {
+                index = _nodes[index].right;
+            }
+        }
+
+        return index;
+    }
+
+    // Returns the next node in order (or nil, if it is the last one)
+    Index _next(Index index) const
+    {
+        if (_nodes[index].right != nil)
+        {
+            return _min(_nodes[index].right);
+        }
+
+        Index parent = _nodes[index].parent;
+        while (parent != nil && _nodes[parent].right == index)
+        {
+            index = parent;
+            parent = _nodes[parent].parent;
+        }
+
+        return parent;
+    }
+
+    // Returns the previous node in order (or nil, if it is the first one)
+    Index _previous(Index index) const
+    {
+        if (_nodes[index].left != nil)
+        {
+            return _max(_nodes[index].left);
+        }
+
+        Index parent = _nodes[index].parent;
+        while (parent != nil && _nodes[parent].left == index)
+        {
+            index = parent;
+            parent = _nodes[parent].parent;
+        }
+
+        return parent;
+    }
+
+    // Rotates the node up over its parent (right rotation, if it is the left child,
+    // otherwise left rotation)
+    void _rotate(Index index) const
+    {
+        hot_node& node = _nodes[index];
+        const Index parent = node.parent;
+        hot_node& parent_node = _nodes[parent];
+        const Index grandparent = parent_node.parent;
+
+        if (parent_node.left == index)
+        {
+            parent_node.left = node.right;
+            if (node.right != nil)
+            {
+                _nodes[node.right].parent = parent;
+            }
+            node.right = parent;
+        }
+        else
+        {
+            parent_node.right = node.left;
+            if (node.left != nil)
+            {
+                _nodes[node.left].parent = parent;
+            }
+            node.left = parent;
+        }
+
+        parent_node.parent = index;
+        node.parent = grandparent;
+        _replace_child(grandparent, parent, index);
+    }
+
+    // Splays the node to the root
+    void _splay(Index index) const
+    {
+        while (_nodes[index].parent != nil)
+        {
+            const Index parent = _nodes[index].parent;
+            const Index grandparent = _nodes[parent].parent;
+
+            if (grandparent != nil)
+            {
+                const bool zig_zig = (_nodes[grandparent].left == parent) == (_nodes[parent].left == index);
+                _rotate(zig_zig ? parent : index);
+            }
+
+            _rotate(index);
+        }
+    }
+
+    // Keys and links of the nodes (links are changed by splaying even in the constant functions)
+    mutable std::vector<hot_node> _nodes;
+
+    // Values of the nodes
+    std::vector<T> _values;
+
+    // Root of the tree
+    mutable Index _root;
+
+    // Comparator
+    Compare _comp;
+
+    // Splay policy
+    Policy _policy;
+};
+
+}   // namespace bushy
+
+#endif // BUSHY_SPLAY_SOA_MAP_H
@@ -0,0 +1,308 @@
+//**************************** LICENSE *************************************
+//
+// Bushy - various search tree implementation library
+// Copyright (C) 2016  Jakub Melka
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//**************************************************************************
+
+#ifndef BUSHY_THREAD_CACHED_ALLOCATOR_H
+#define BUSHY_THREAD_CACHED_ALLOCATOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+namespace bushy
+{
+
+namespace impl
+{
+
+// Pool of the blocks of one size. Each thread has its own cache (free list) of the
+// blocks, so allocation and deallocation does not take any lock. Blocks are moved
+// between the thread cache and the shared pool in batches: empty cache takes one batch
+// from the shared pool, cache with too many blocks (or cache of the finishing thread)
+// returns batches to the shared pool. Any thread can deallocate any block, so maps can
+// be destroyed on other thread, than the one, which created them.
+//
+// NOTE: Memory of the blocks is never returned to the system, it is kept in the
+// shared pool for the reuse. Shared pool is intentionally never destroyed, so
+// blocks can be deallocated even during the destruction of static objects. Thread
+// caches are destroyed before the static objects, so blocks allocated and deallocated
+// after the destruction of the cache go directly through the shared pool.
+template<std::size_t BlockSize, std::size_t BatchSize, std::size_t Alignment>
+class thread_cache_pool
+{
+public:
+    static void* allocate() { return _cache_destroyed() ? _pop_shared() : _local().pop(); }
+
+    static void deallocate(void* pointer)
+    {
+        if (_cache_destroyed())
+        {
+            _push_shared(static_cast<block*>(pointer));
+        }
+        else
+        {
+            _local().push(static_cast<block*>(pointer));
+        }
+    }
+
+private:
+    // Free block, blocks in the batch are linked by next, batches in the shared pool
+    // are linked by next_batch of their first block.
+    struct block
+    {
+        block* next;
+        block* next_batch;
+        std::size_t batch_size;
+    };
+
+    static_assert(BlockSize >= sizeof(block) && BlockSize % Alignment == 0 && Alignment % alignof(std::max_align_t) == 0, "Invalid block size!");
+    static_assert(BatchSize > 0, "Batch size must be positive!");
+
+    // Pool of the batches shared by all threads
+    class shared_pool
+    {
+    public:
+        // Returns batch of the free blocks (reused, or newly allocated)
+        block* acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                if (_batches)
+                {
+                    block* batch = _batches;
+                    _batches = batch->next_batch;
+                    return batch;
+                }
+            }
+
+            // Allocate the new batch outside of the lock. Over-aligned batches are allocated
+            // with extra space for the alignment (batches are never deallocated).
+            const std::size_t extra = Alignment > alignof(std::max_align_t) ? Alignment : 0;
+            char* memory = static_cast<char*>(::operator new(BlockSize * BatchSize + extra));
+            memory += (Alignment - reinterpret_cast<std::uintptr_t>(memory) % Alignment) % Alignment;
+
+            block* batch = nullptr;
+            for (std::size_t i = BatchSize; i > 0; --i)
+            {
+                block* current = reinterpret_cast<block*>(memory + (i - 1) * BlockSize);
+                current->next = batch;
+                batch = current;
+            }
+
+            batch->batch_size = BatchSize;
+            return batch;
+        }
+
+        // Returns batch of the free blocks to the pool
+        void release(block* batch, std::size_t size)
+        {
+            batch->batch_size = size;
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            batch->next_batch = _batches;
+            _batches = batch;
+        }
+
+    private:
+        std::mutex _mutex;
+        block* _batches = nullptr;
+    };
+
+    // Free list of the thread
+    class local_cache
+    {
+    public:
+        // Returns all blocks to the shared pool, when the thread finishes
+        ~local_cache()
+        {
+            while (_head)
+            {
+                _release_batch(std::min(_size, BatchSize));
+            }
+
+            _cache_destroyed() = true;
+        }
+
+        block* pop()
+        {
+            if (!_head)
+            {
+                _head = _shared().acquire();
+                _size = _head->batch_size;
+            }
+
+            block* result = _head;
+            _head = _head->next;
+            --_size;
+            return result;
+        }
+
+        void push(block* value)
+        {
+            value->next = _head;
+            _head = value;
+
+            if (++_size >= 2 * BatchSize)
+            {
+                _release_batch(BatchSize);
+            }
+        }
+
+    private:
+        // Detaches the first count blocks and returns them to the shared pool
+        void _release_batch(std::size_t count)
+        {
+            block* batch = _head;
+            block* last = _head;
+            for (std::size_t i = 1; i < count; ++i)
+            {
+                last = last->next;
+            }
+
+            _head = last->next;
+            _size -= count;
+            last->next = nullptr;
+            _shared().release(batch, count);
+        }
+
+        block* _head = nullptr;
+        std::size_t _size = 0;
+    };
+
+    static shared_pool& _shared()
+    {
+        static shared_pool* pool = new shared_pool();
+        return *pool;
+    }
+
+    static local_cache& _local()
+    {
+        static thread_local local_cache cache;
+        return cache;
+    }
+
+    // Flag of the destroyed cache of the thread. It is trivially destructible,
+    // so it can be read even after the cache is destroyed.
+    static bool& _cache_destroyed()
+    {
+        static thread_local bool destroyed = false;
+        return destroyed;
+    }
+
+    // Takes one block of the batch from the shared pool, rest of the batch is returned
+    static void* _pop_shared()
+    {
+        block* batch = _shared().acquire();
+
+        if (batch->next)
+        {
+            _shared().release(batch->next, batch->batch_size - 1);
+        }
+
+        return batch;
+    }
+
+    // Returns the block to the shared pool as a batch of one block
+    static void _push_shared(block* value)
+    {
+        value->next = nullptr;
+        _shared().release(value, 1);
+    }
+};
+
+}   // namespace impl
+
+// Thread cached allocator - allocator of single objects (tree nodes), which
+// keeps free blocks in the caches of the threads, so threads allocating their own
+// maps do not contend on the lock of the global allocator. The lock of the shared
+// pool is taken once per BatchSize allocations/deallocations. All instances are
+// equal, memory allocated in one thread can be deallocated in another thread.
+// Arrays (allocation of more than one object) use the global allocator,
+// so they can't contain over-aligned objects (single objects can).
+template<typename T, std::size_t BatchSize = 64>
+class thread_cached_allocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type is_always_equal;
+
+    template<typename U>
+    struct rebind
+    {
+        typedef thread_cached_allocator<U, BatchSize> other;
+    };
+
+    thread_cached_allocator() = default;
+
+    template<typename U>
+    thread_cached_allocator(const thread_cached_allocator<U, BatchSize>&) { }
+
+    T* allocate(std::size_t count)
+    {
+        if (count == 1)
+        {
+            return static_cast<T*>(pool::allocate());
+        }
+
+        if (alignof(T) > alignof(std::max_align_t))
+        {
+            // Global allocator does not align arrays of over-aligned objects (before C++17)
+            throw std::bad_alloc();
+        }
+
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t count)
+    {
+        if (count == 1)
+        {
+            pool::deallocate(pointer);
+        }
+        else
+        {
+            ::operator delete(pointer);
+        }
+    }
+
+private:
+    // Alignment of the block - alignment of the object, at least the fundamental alignment
+    // (std::max is not constexpr in C++11)
+    static constexpr std::size_t block_alignment = alignof(T) > alignof(std::max_align_t) ? alignof(T) : alignof(std::max_align_t);
+
+    // Size of the block - size of the object rounded up to the block alignment
+    static constexpr std::size_t block_size = ((sizeof(T) > 3 * sizeof(void*) ? sizeof(T) : 3 * sizeof(void*)) + block_alignment - 1) / block_alignment * block_alignment;
+
+    typedef impl::thread_cache_pool<block_size, BatchSize, block_alignment> pool;
+};
+
+template<typename T, typename U, std::size_t BatchSize>
+bool operator==(const thread_cached_allocator<T, BatchSize>&, const thread_cached_allocator<U, BatchSize>&) { return true; }
+
+template<typename T, typename U, std::size_t BatchSize>
+bool operator!=(const thread_cached_allocator<T, BatchSize>&, const thread_cached_allocator<U, BatchSize>&) { return false; }
+
+}   // namespace bushy
+
+#endif // BUSHY_THREAD_CACHED_ALLOCATOR_H
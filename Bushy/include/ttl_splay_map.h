@@ -0,0 +1,150 @@
+//**************************** LICENSE *************************************
+//
+// Bushy - various search tree implementation library
+// Copyright (C) 2016  Jakub Melka
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//**************************************************************************
+
+#ifndef BUSHY_TTL_SPLAY_MAP_H
+#define BUSHY_TTL_SPLAY_MAP_H
+
+#include "splay_map.h"
+
+#include <chrono>
+#include <functional>
+
+namespace bushy
+{
+
+// Time-to-live map - splay map keyed by time points, which drops entries
+// older than the time to live. Expiration is triggered by the tick() function,
+// at most once per expire period, and it uses splay_map::expire_before, so
+// the whole expired part of the tree is removed at once.
+//
+// NOTE: This class does not read the clock by itself (except the tick()
+// function without parameters), so it can be used also for event time windows.
+template<typename T,
+         typename Clock = std::chrono::steady_clock,
+         typename Allocator = std::allocator<std::pair<const typename Clock::time_point, T>>,
+         typename Policy = splay_map_policy<splay_mode::FOURTH, splay_mode::THIRD>>
+class ttl_splay_map
+{
+public:
+    typedef typename Clock::time_point time_point;
+    typedef typename Clock::duration duration;
+    typedef splay_map<time_point, T, std::less<time_point>, Allocator, Policy> map_type;
+    typedef typename map_type::key_type key_type;
+    typedef typename map_type::mapped_type mapped_type;
+    typedef typename map_type::value_type value_type;
+    typedef typename map_type::size_type size_type;
+    typedef typename map_type::iterator iterator;
+    typedef typename map_type::const_iterator const_iterator;
+    typedef std::function<void(value_type&)> evictor_type;
+
+    // Creates the map with time to live and expire period. Evictor (if it is set)
+    // is called with each expired value before it is destroyed.
+    explicit ttl_splay_map(duration ttl, duration expire_period = duration::zero(), evictor_type evictor = evictor_type()) :
+        _ttl(ttl),
+        _period(expire_period),
+        _next_expire(time_point::min()),
+        _evictor(std::move(evictor))
+    {
+
+    }
+
+    // Time to live and expire period
+    duration ttl() const { return _ttl; }
+    void set_ttl(duration ttl) { _ttl = ttl; }
+    duration expire_period() const { return _period; }
+    void set_expire_period(duration period) { _period = period; }
+
+    // Underlying map
+    map_type& map() { return _map; }
+    const map_type& map() const { return _map; }
+
+    // Capacity
+    bool empty() const { return _map.empty(); }
+    size_type size() const { return _map.size(); }
+
+    // Iterators
+    iterator begin() { return _map.begin(); }
+    const_iterator begin() const { return _map.begin(); }
+    const_iterator cbegin() const { return _map.cbegin(); }
+
+    iterator end() { return _map.end(); }
+    const_iterator end() const { return _map.end(); }
+    const_iterator cend() const { return _map.cend(); }
+
+    // Modifiers
+    void clear() { _map.clear(); }
+
+    std::pair<iterator, bool> insert(time_point stamp, const T& value) { return _map.try_emplace(stamp, value); }
+    std::pair<iterator, bool> insert(time_point stamp, T&& value) { return _map.try_emplace(stamp, std::move(value)); }
+
+    template<class... Args>
+    std::pair<iterator, bool> emplace(time_point stamp, Args&&... args) { return _map.try_emplace(stamp, std::forward<Args>(args)...); }
+
+    T& operator[](time_point stamp) { return _map[stamp]; }
+
+    // Removes all entries older than now - ttl, if the expire period elapsed
+    // since the last expiration. Returns count of removed entries.
+    size_type tick(time_point now)
+    {
+        if (now < _next_expire)
+        {
+            // It is not the time to expire yet
+            return 0;
+        }
+
+        _next_expire = now + _period;
+        return expire(now);
+    }
+
+    // Tick using the current time of the clock
+    size_type tick() { return tick(Clock::now()); }
+
+    // Removes all entries older than now - ttl immediately. Returns
+    // count of removed entries.
+    size_type expire(time_point now)
+    {
+        if (_evictor)
+        {
+            return _map.expire_before(now - _ttl, std::ref(_evictor));
+        }
+
+        return _map.expire_before(now - _ttl);
+    }
+
+private:
+    // Underlying map
+    map_type _map;
+
+    // Time to live of the entries
+    duration _ttl;
+
+    // Minimal period between two expirations
+    duration _period;
+
+    // Time of the next scheduled expiration
+    time_point _next_expire;
+
+    // Callback for expired values
+    evictor_type _evictor;
+};
+
+}   // namespace bushy
+
+#endif // BUSHY_TTL_SPLAY_MAP_H
@@ -3,11 +3,20 @@
 #include <QCoreApplication>
 
 #include <map>
+#include <random>
+#include <thread>
 #include <type_traits>
 
 #include "MapTestAlgorithms.h"
 
 #include "../Bushy/include/splay_map.h"
+#include "../Bushy/include/ttl_splay_map.h"
+#include "../Bushy/include/prefix_splay_map.h"
+#include "../Bushy/include/arena_splay_map.h"
+#include "../Bushy/include/thread_cached_allocator.h"
+#include "../Bushy/include/huge_page_allocator.h"
+#include "../Bushy/include/shared_node_pool.h"
+#include "../Bushy/include/splay_soa_map.h"
 
 class splay_map_test : public QObject
 {
@@ -33,6 +42,28 @@ private Q_SLOTS:
     void testCountFind();
     void testLowerUpperBounds();
     void testMiscellanneousOperations();
+    void testExpire();
+    void testEraseSorted();
+    void testInsertBatch();
+    void testForEach();
+    void testExport();
+    void testIntegralKeys();
+    void testPrefixMap();
+    void testArenaMap();
+    void testMemoryResource();
+    void testClear();
+    void testThreadCachedAllocator();
+    void testHugePageAllocator();
+    void testSharedNodePool();
+    void testSoaMap();
+    void testPrefetch();
+    void testNodeAlignment();
+    void testHintedSearch();
+    void testInsertHintValidation();
+    void testTopDownInsert();
+    void testEraseMode();
+    void testTombstones();
+    void testDeferredSplay();
 };
 
 splay_map_test::splay_map_test()
@@ -281,8 +312,76 @@ void splay_map_test::testIterators()
             QVERIFY((it == bushy::splay_map<int, char>::iterator{}));
         }
     }
+
+    {
+        // Iterator is a single pointer, it doesn't need the map to iterate
+        static_assert(sizeof(bushy::splay_map<int, char>::iterator) == sizeof(void*), "Iterator must be a single pointer!");
+        static_assert(sizeof(bushy::splay_map<int, char>::const_iterator) == sizeof(void*), "Iterator must be a single pointer!");
+
+        bushy::splay_map<int, char> map;
+        QVERIFY(map.begin() == map.end());
+
+        // Single element - the element and the end
+        map[5] = 'a';
+        QVERIFY(std::next(map.begin()) == map.end());
+        QVERIFY(std::prev(map.end()) == map.begin());
+        QVERIFY(map.rbegin()->first == 5 && std::next(map.rbegin()) == map.rend());
+
+        // Iterators stored aside stay valid, while the tree is splayed
+        std::vector<bushy::splay_map<int, char>::const_iterator> iterators;
+        for (int i = 0; i < 200; ++i)
+        {
+            const int key = (i * 37) % 211;
+            iterators.push_back(map.emplace(key, static_cast<char>(key)).first);
+            map.find((i * 13) % 211);
+        }
+
+        for (bushy::splay_map<int, char>::const_iterator it : iterators)
+        {
+            QVERIFY(map.find(it->first) == it);
+
+            // Neighbours of the stored iterator
+            bushy::splay_map<int, char>::const_iterator next = std::next(it);
+            QVERIFY(next == map.cend() || next->first > it->first);
+            QVERIFY(it == map.cbegin() || std::prev(it)->first < it->first);
+            QVERIFY(std::prev(next) == it);
+        }
+
+        // Backward iteration visits all elements
+        std::size_t count = 0;
+        for (auto it = map.crbegin(); it != map.crend(); ++it)
+        {
+            ++count;
+        }
+        QVERIFY(count == map.size());
+    }
 }
 
+// Count of the allocations of all counting allocators (of all types)
+static std::size_t counted_allocations = 0;
+
+// Allocator, which counts its allocations
+template<typename T>
+struct counting_allocator : std::allocator<T>
+{
+    counting_allocator() = default;
+
+    template<class U>
+    counting_allocator(const counting_allocator<U>&) { }
+
+    template<class U>
+    struct rebind
+    {
+        typedef counting_allocator<U> other;
+    };
+
+    T* allocate(std::size_t count)
+    {
+        ++counted_allocations;
+        return std::allocator<T>::allocate(count);
+    }
+};
+
 void splay_map_test::testAssignOperators()
 {
     using TestMap = bushy::splay_map<int, char>;
@@ -363,6 +462,87 @@ void splay_map_test::testAssignOperators()
 
         test_map_equality<TestMap, StandardMap>(testMap, standardMap);
     }
+
+    {
+        // Assign function
+        StandardMap standardMap = { {1, 'a'}, {2, 'b'}, {3, 'c'}, {7, 'd'} };
+        TestMap testMap = { {4, 'a'}, {5, 'b'}, {6, 'c'} };
+        testMap.assign(standardMap.cbegin(), standardMap.cend());
+        test_map_equality<TestMap, StandardMap>(testMap, standardMap);
+
+        // Unsorted range with duplicate keys
+        std::vector<std::pair<int, char>> values = { {9, 'a'}, {2, 'b'}, {9, 'c'}, {1, 'd'} };
+        testMap.assign(values.cbegin(), values.cend());
+        standardMap = { {1, 'd'}, {2, 'b'}, {9, 'a'} };
+        test_map_equality<TestMap, StandardMap>(testMap, standardMap);
+
+        testMap.assign(values.cend(), values.cend());
+        QVERIFY(testMap.empty());
+    }
+
+    {
+        // Nodes are reused by the assignment
+        using CountingAllocator = counting_allocator<std::pair<const int, std::string>>;
+        using CountingMap = bushy::splay_map<int, std::string, std::less<int>, CountingAllocator>;
+        using CountingStandardMap = std::map<int, std::string>;
+
+        CountingStandardMap standardMap;
+        CountingMap other;
+        for (int i = 0; i < 1000; ++i)
+        {
+            standardMap[i * 7 % 1000] = std::to_string(i);
+            other[i * 7 % 1000] = std::to_string(i);
+        }
+
+        CountingMap testMap;
+        for (int i = 0; i < 1200; ++i)
+        {
+            testMap[i] = "old";
+        }
+
+        const std::size_t allocations = counted_allocations;
+        testMap = other;
+        testMap.assign(other.cbegin(), other.cend());
+        testMap = other;
+        QVERIFY(counted_allocations == allocations);
+        QVERIFY(is_range_equals(testMap.cbegin(), testMap.cend(), standardMap.cbegin(), standardMap.cend()));
+
+        // Map grows, only the missing nodes are allocated
+        CountingMap small;
+        small = { { 1, "a" }, { 2, "b" } };
+        const std::size_t small_allocations = counted_allocations;
+        small = other;
+        QVERIFY(counted_allocations == small_allocations + other.size() - 2);
+        QVERIFY(is_range_equals(small.cbegin(), small.cend(), standardMap.cbegin(), standardMap.cend()));
+    }
+
+    {
+        // Exception during the construction of the value
+        struct throwing_value
+        {
+            throwing_value(int value) : value(value) { if (value == 5) { throw std::runtime_error("Value 5!"); } }
+            int value;
+        };
+
+        bushy::splay_map<int, throwing_value> testMap;
+        testMap.emplace(1, 1);
+        testMap.emplace(2, 2);
+
+        std::vector<std::pair<int, int>> values = { {1, 1}, {3, 3}, {4, 4}, {5, 5}, {6, 6} };
+        bool exception_thrown = false;
+        try
+        {
+            testMap.assign(values.cbegin(), values.cend());
+        }
+        catch (std::runtime_error)
+        {
+            exception_thrown = true;
+        }
+
+        QVERIFY(exception_thrown);
+        QVERIFY(testMap.size() == 3);
+        QVERIFY(testMap.begin()->first == 1 && std::prev(testMap.end())->first == 4);
+    }
 }
 
 void splay_map_test::testAccessOperators()
@@ -1552,6 +1732,2086 @@ void splay_map_test::testMiscellanneousOperations()
     }
 }
 
+void splay_map_test::testExpire()
+{
+    using TestMap = bushy::splay_map<int, int>;
+    using StandardMap = std::map<int, int>;
+
+    std::vector<int> values(100);
+    std::iota(values.begin(), values.end(), 0);
+    std::random_shuffle(values.begin(), values.end());
+
+    for (int key = -5; key < 106; key += 7)
+    {
+        TestMap test_map;
+        StandardMap standard_map;
+
+        for (const int value : values)
+        {
+            test_map.insert(std::make_pair(value, value * 37));
+            standard_map.insert(std::make_pair(value, value * 37));
+        }
+
+        std::vector<int> evicted;
+        const std::size_t count = test_map.expire_before(key, [&evicted](TestMap::value_type& value) { evicted.push_back(value.first); });
+        auto last = standard_map.lower_bound(key);
+        QVERIFY(count == static_cast<std::size_t>(std::distance(standard_map.begin(), last)));
+        QVERIFY(evicted.size() == count);
+        QVERIFY(std::is_sorted(evicted.begin(), evicted.end()));
+        standard_map.erase(standard_map.begin(), last);
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+        auto first = standard_map.upper_bound(key + 20);
+        QVERIFY(test_map.expire_after(key + 20) == static_cast<std::size_t>(std::distance(first, standard_map.end())));
+        standard_map.erase(first, standard_map.end());
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+    }
+
+    {
+        TestMap test_map = { {1, 1}, {2, 2}, {3, 3} };
+        StandardMap standard_map;
+
+        QVERIFY(test_map.expire_after(0) == 3);
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+        QVERIFY(test_map.expire_before(0) == 0);
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+    }
+
+    {
+        using Clock = std::chrono::steady_clock;
+        using TtlMap = bushy::ttl_splay_map<int, Clock>;
+
+        int evicted = 0;
+        TtlMap ttl_map(std::chrono::seconds(10), std::chrono::seconds(5), [&evicted](TtlMap::value_type&) { ++evicted; });
+        const Clock::time_point start = Clock::now();
+
+        for (int i = 0; i < 30; ++i)
+        {
+            ttl_map.insert(start + std::chrono::seconds(i), i);
+        }
+
+        QVERIFY(ttl_map.tick(start + std::chrono::seconds(20)) == 10);
+        QVERIFY(ttl_map.size() == 20);
+        QVERIFY(ttl_map.begin()->second == 10);
+
+        // Expire period did not elapse yet
+        QVERIFY(ttl_map.tick(start + std::chrono::seconds(22)) == 0);
+        QVERIFY(ttl_map.tick(start + std::chrono::seconds(25)) == 5);
+        QVERIFY(ttl_map.expire(start + std::chrono::seconds(40)) == 15);
+        QVERIFY(ttl_map.empty());
+        QVERIFY(evicted == 30);
+    }
+}
+
+void splay_map_test::testEraseSorted()
+{
+    using TestMap = bushy::splay_map<int, int>;
+    using StandardMap = std::map<int, int>;
+
+    std::vector<int> values(200);
+    std::iota(values.begin(), values.end(), 0);
+
+    for (const int step : { 1, 2, 3, 7, 50 })
+    {
+        std::random_shuffle(values.begin(), values.end());
+
+        TestMap test_map;
+        StandardMap standard_map;
+
+        for (const int value : values)
+        {
+            test_map.insert(std::make_pair(value * 2, value));
+            standard_map.insert(std::make_pair(value * 2, value));
+        }
+
+        // Keys to erase, some of them are not in the map
+        std::vector<int> keys;
+        for (int key = -10; key < 420; key += step)
+        {
+            keys.push_back(key);
+        }
+
+        std::size_t count = 0;
+        for (const int key : keys)
+        {
+            count += standard_map.erase(key);
+        }
+
+        QVERIFY(test_map.erase_sorted(keys.cbegin(), keys.cend()) == count);
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+        // Erase the rest of the map
+        std::sort(values.begin(), values.end());
+        for (int& value : values)
+        {
+            value *= 2;
+        }
+
+        QVERIFY(test_map.erase_sorted(values.cbegin(), values.cend()) == standard_map.size());
+        standard_map.clear();
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+        std::iota(values.begin(), values.end(), 0);
+    }
+}
+
+void splay_map_test::testInsertBatch()
+{
+    using TestMap = bushy::splay_map<int, int>;
+    using StandardMap = std::map<int, int>;
+
+    for (const int initial_size : { 0, 10, 100, 1000 })
+    {
+        for (const int batch_size : { 0, 1, 10, 100, 1000 })
+        {
+            TestMap test_map;
+            StandardMap standard_map;
+
+            for (int i = 0; i < initial_size; ++i)
+            {
+                const int key = std::rand() % 2000;
+                test_map.insert(std::make_pair(key, i));
+                standard_map.insert(std::make_pair(key, i));
+            }
+
+            // Batch with duplicates, values with the same key differ
+            std::vector<std::pair<int, int>> batch;
+            for (int i = 0; i < batch_size; ++i)
+            {
+                batch.push_back(std::make_pair(std::rand() % 2000, -i));
+            }
+
+            std::size_t count = 0;
+            for (const auto& item : batch)
+            {
+                count += standard_map.insert(item).second ? 1 : 0;
+            }
+
+            QVERIFY(test_map.insert_batch(batch.cbegin(), batch.cend()) == count);
+            test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+            for (const auto& item : standard_map)
+            {
+                QVERIFY(test_map.find(item.first) != test_map.end());
+            }
+        }
+    }
+}
+
+void splay_map_test::testForEach()
+{
+    using TestMap = bushy::splay_map<int, int>;
+    using StandardMap = std::map<int, int>;
+
+    std::vector<int> values(100);
+    std::iota(values.begin(), values.end(), 0);
+    std::random_shuffle(values.begin(), values.end());
+
+    TestMap test_map;
+    StandardMap standard_map;
+
+    for (const int value : values)
+    {
+        test_map.insert(std::make_pair(value * 2, value));
+        standard_map.insert(std::make_pair(value * 2, value));
+    }
+
+    {
+        std::vector<TestMap::value_type> visited;
+        QVERIFY(test_map.for_each([&visited](const TestMap::value_type& value) { visited.push_back(value); }));
+        QVERIFY(is_range_equals(visited.cbegin(), visited.cend(), standard_map.cbegin(), standard_map.cend()));
+
+        visited.clear();
+        const TestMap& const_map = test_map;
+        QVERIFY(const_map.for_each_reverse([&visited](const TestMap::value_type& value) { visited.push_back(value); }));
+        QVERIFY(is_range_equals(visited.cbegin(), visited.cend(), standard_map.crbegin(), standard_map.crend()));
+    }
+
+    for (int low = -5; low < 205; low += 9)
+    {
+        for (int high = low - 10; high < 215; high += 13)
+        {
+            auto first = standard_map.lower_bound(low);
+            auto last = (low < high) ? standard_map.lower_bound(high) : first;
+
+            std::vector<TestMap::value_type> visited;
+            QVERIFY(test_map.for_each_range(low, high, [&visited](const TestMap::value_type& value) { visited.push_back(value); }));
+            QVERIFY(is_range_equals(visited.cbegin(), visited.cend(), first, last));
+
+            visited.clear();
+            QVERIFY(test_map.for_each_range_reverse(low, high, [&visited](const TestMap::value_type& value) { visited.push_back(value); }));
+            QVERIFY(is_range_equals(visited.cbegin(), visited.cend(), StandardMap::const_reverse_iterator(last), StandardMap::const_reverse_iterator(first)));
+        }
+    }
+
+    {
+        // Early exit and modification of the values
+        int count = 0;
+        QVERIFY(!test_map.for_each([&count](TestMap::value_type& value) { value.second = -value.second; return ++count < 10; }));
+        QVERIFY(count == 10);
+
+        count = 0;
+        QVERIFY(!test_map.for_each_range_reverse(0, 20, [&count](TestMap::value_type& value) { return value.second < 0 && ++count < 5; }));
+        QVERIFY(count == 5);
+        QVERIFY(test_map.at(18) == -9);
+        QVERIFY(test_map.at(20) == 10);
+    }
+}
+
+void splay_map_test::testExport()
+{
+    using TestMap = bushy::splay_map<int, int>;
+    using StandardMap = std::map<int, int>;
+
+    std::vector<int> input(100);
+    std::iota(input.begin(), input.end(), 0);
+    std::random_shuffle(input.begin(), input.end());
+
+    TestMap test_map;
+    StandardMap standard_map;
+
+    for (const int value : input)
+    {
+        test_map.insert(std::make_pair(value * 2, value * 37));
+        standard_map.insert(std::make_pair(value * 2, value * 37));
+    }
+
+    std::vector<int> standard_keys;
+    std::vector<int> standard_values;
+    for (const auto& item : standard_map)
+    {
+        standard_keys.push_back(item.first);
+        standard_values.push_back(item.second);
+    }
+
+    {
+        std::vector<int> keys(150, -1);
+        std::vector<int> values(150, -1);
+
+        QVERIFY(test_map.export_keys(keys.data(), keys.size()) == standard_map.size());
+        QVERIFY(test_map.export_values(values.data(), values.size()) == standard_map.size());
+        QVERIFY(std::equal(standard_keys.cbegin(), standard_keys.cend(), keys.cbegin()));
+        QVERIFY(std::equal(standard_values.cbegin(), standard_values.cend(), values.cbegin()));
+        QVERIFY(keys[standard_map.size()] == -1);
+        QVERIFY(values[standard_map.size()] == -1);
+
+        QVERIFY(test_map.export_keys(keys.data(), 0) == 0);
+        QVERIFY(test_map.export_all(keys.data(), values.data(), 10) == 10);
+        QVERIFY(std::equal(standard_keys.cbegin(), standard_keys.cbegin() + 10, keys.cbegin()));
+        QVERIFY(std::equal(standard_values.cbegin(), standard_values.cbegin() + 10, values.cbegin()));
+    }
+
+    for (int low = -5; low < 205; low += 9)
+    {
+        for (int high = low - 10; high < 215; high += 13)
+        {
+            auto first = standard_map.lower_bound(low);
+            auto last = (low < high) ? standard_map.lower_bound(high) : first;
+            const std::size_t count = std::distance(first, last);
+            const std::size_t offset = std::distance(standard_map.begin(), first);
+
+            std::vector<int> keys(count + 1, -1);
+            std::vector<int> values(count + 1, -1);
+
+            QVERIFY(test_map.export_range(low, high, keys.data(), values.data(), keys.size()) == count);
+            QVERIFY(std::equal(keys.cbegin(), keys.cbegin() + count, standard_keys.cbegin() + offset));
+            QVERIFY(std::equal(values.cbegin(), values.cbegin() + count, standard_values.cbegin() + offset));
+
+            if (count > 1)
+            {
+                QVERIFY(test_map.export_range(low, high, nullptr, values.data(), count - 1) == count - 1);
+            }
+        }
+    }
+}
+
+void splay_map_test::testIntegralKeys()
+{
+    static_assert(bushy::is_integral_key_compare<int, std::less<int>>::value, "Integral key search must be enabled!");
+    static_assert(bushy::is_integral_key_compare<unsigned char, std::less<void>>::value, "Integral key search must be enabled!");
+    static_assert(!bushy::is_integral_key_compare<int, std::greater<int>>::value, "Integral key search must be disabled!");
+    static_assert(!bushy::is_integral_key_compare<double, std::less<double>>::value, "Integral key search must be disabled!");
+
+    {
+        using TestMap = bushy::int_splay_map<long long, int>;
+        using StandardMap = std::map<long long, int>;
+
+        TestMap test_map;
+        StandardMap standard_map;
+
+        const long long keys[] = { std::numeric_limits<long long>::min(), -1000, -1, 0, 1, 7, 1000, std::numeric_limits<long long>::max() };
+        for (const long long key : keys)
+        {
+            test_map[key] = static_cast<int>(key % 100);
+            standard_map[key] = static_cast<int>(key % 100);
+        }
+
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+        for (const long long key : { std::numeric_limits<long long>::min(), -1001LL, -1000LL, -2LL, 0LL, 6LL, 7LL, 8LL, std::numeric_limits<long long>::max() })
+        {
+            QVERIFY(test_map.count(key) == standard_map.count(key));
+            test_iterator_equal(test_map.find(key), standard_map.find(key), test_map.cend(), standard_map.cend());
+            test_iterator_equal(test_map.lower_bound(key), standard_map.lower_bound(key), test_map.cend(), standard_map.cend());
+            test_iterator_equal(test_map.upper_bound(key), standard_map.upper_bound(key), test_map.cend(), standard_map.cend());
+        }
+    }
+
+    {
+        using TestMap = bushy::splay_map<unsigned, int, std::greater<unsigned>>;
+        using StandardMap = std::map<unsigned, int, std::greater<unsigned>>;
+
+        TestMap test_map;
+        StandardMap standard_map;
+
+        for (unsigned key = 0; key < 100; ++key)
+        {
+            test_map.insert(std::make_pair((key * 37) % 101, key));
+            standard_map.insert(std::make_pair((key * 37) % 101, key));
+        }
+
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+        for (unsigned key = 0; key < 110; ++key)
+        {
+            test_iterator_equal(test_map.find(key), standard_map.find(key), test_map.cend(), standard_map.cend());
+            QVERIFY(test_map.erase(key) == standard_map.erase(key));
+        }
+
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+    }
+}
+
+// Compares the prefix map with the standard map, iterating in both directions
+template<typename PrefixMap, typename StandardMap>
+static void test_prefix_map_equality(const PrefixMap& prefix_map, const StandardMap& standard_map)
+{
+    QVERIFY(prefix_map.size() == standard_map.size());
+    QVERIFY(prefix_map.empty() == standard_map.empty());
+
+    auto it = prefix_map.cbegin();
+    for (const auto& item : standard_map)
+    {
+        QVERIFY(it != prefix_map.cend());
+        QVERIFY(it->first == item.first);
+        QVERIFY(it->second == item.second);
+        ++it;
+    }
+    QVERIFY(it == prefix_map.cend());
+
+    for (auto standard_it = standard_map.crbegin(); standard_it != standard_map.crend(); ++standard_it)
+    {
+        --it;
+        QVERIFY((*it).first == standard_it->first);
+        QVERIFY((*it).second == standard_it->second);
+    }
+    QVERIFY(it == prefix_map.cbegin());
+}
+
+// Compares the iterators of the prefix map and the standard map
+template<typename PrefixIterator, typename StandardIterator>
+static void test_prefix_iterator_equal(PrefixIterator left, StandardIterator right, PrefixIterator leftEnd, StandardIterator rightEnd)
+{
+    const bool leftValid = left != leftEnd;
+    const bool rightValid = right != rightEnd;
+    QVERIFY(leftValid == rightValid);
+
+    if (leftValid && rightValid)
+    {
+        QVERIFY(left->first == right->first);
+        QVERIFY(left->second == right->second);
+    }
+}
+
+void splay_map_test::testPrefixMap()
+{
+    using TestMap = bushy::prefix_splay_map<int, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD>, 8>;
+    using StandardMap = std::map<std::string, int>;
+
+    // Path-like keys with long shared prefixes, also keys which are prefixes of other keys
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2000; ++i)
+    {
+        const std::string directory = "/usr/share/doc/package" + std::to_string(i % 37) + "/";
+        keys.push_back(directory + "file" + std::to_string(i));
+        if (i % 10 == 0)
+        {
+            keys.push_back(directory);
+            keys.push_back(directory.substr(0, directory.size() - 1));
+        }
+    }
+    keys.push_back(std::string());
+    keys.push_back(std::string("\xFF\xFE"));
+
+    std::minstd_rand engine(0);
+    std::shuffle(keys.begin(), keys.end(), engine);
+
+    TestMap test_map;
+    StandardMap standard_map;
+
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        const auto result = test_map.insert(std::make_pair(keys[i], static_cast<int>(i)));
+        const auto standard_result = standard_map.insert(std::make_pair(keys[i], static_cast<int>(i)));
+        QVERIFY(result.second == standard_result.second);
+        QVERIFY(result.first->first == standard_result.first->first);
+        QVERIFY(result.first->second == standard_result.first->second);
+    }
+
+    test_prefix_map_equality(test_map, standard_map);
+
+    // Lookups of existing keys, their prefixes and extensions
+    for (const std::string& key : keys)
+    {
+        for (const std::string& searched : { key, key.substr(0, key.size() / 2), key + "0", key + "~" })
+        {
+            QVERIFY(test_map.count(searched) == standard_map.count(searched));
+            test_prefix_iterator_equal(test_map.find(searched), standard_map.find(searched), test_map.end(), standard_map.end());
+            test_prefix_iterator_equal(test_map.lower_bound(searched), standard_map.lower_bound(searched), test_map.end(), standard_map.end());
+            test_prefix_iterator_equal(test_map.upper_bound(searched), standard_map.upper_bound(searched), test_map.end(), standard_map.end());
+        }
+    }
+
+    // Access and assignment
+    test_map["/a/new/key"] = 5;
+    standard_map["/a/new/key"] = 5;
+    test_map.at(keys.front()) = -1;
+    standard_map.at(keys.front()) = -1;
+    QVERIFY(test_map.insert_or_assign(keys.back(), -2).second == false);
+    standard_map[keys.back()] = -2;
+
+    bool thrown = false;
+    try
+    {
+        test_map.at("/not/in/map");
+    }
+    catch (const std::out_of_range&)
+    {
+        thrown = true;
+    }
+    QVERIFY(thrown);
+
+    test_prefix_map_equality(test_map, standard_map);
+
+    // Visitation
+    std::vector<std::pair<std::string, int>> visited;
+    QVERIFY(test_map.for_each([&visited](const TestMap::const_reference& item) { visited.push_back(std::make_pair(item.first, item.second)); }));
+    QVERIFY(visited.size() == standard_map.size());
+    QVERIFY(std::equal(visited.cbegin(), visited.cend(), standard_map.cbegin(), [](const std::pair<std::string, int>& left, const StandardMap::value_type& right) { return left.first == right.first && left.second == right.second; }));
+
+    // Erase by key, erase by iterator
+    std::shuffle(keys.begin(), keys.end(), engine);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        if (i % 3 == 0)
+        {
+            auto it = test_map.find(keys[i]);
+            auto standard_it = standard_map.find(keys[i]);
+            if (it != test_map.end())
+            {
+                test_prefix_iterator_equal(test_map.erase(it), standard_map.erase(standard_it), test_map.end(), standard_map.end());
+            }
+        }
+        else if (i % 3 == 1)
+        {
+            QVERIFY(test_map.erase(keys[i]) == standard_map.erase(keys[i]));
+        }
+
+        if (i % 500 == 0)
+        {
+            test_prefix_map_equality(test_map, standard_map);
+        }
+    }
+
+    test_prefix_map_equality(test_map, standard_map);
+
+    // Copy, erase of all remaining keys
+    TestMap copy(test_map);
+    test_prefix_map_equality(copy, standard_map);
+
+    for (const std::string& key : keys)
+    {
+        copy.erase(key);
+    }
+
+    QVERIFY(copy.erase("/a/new/key") == 1);
+    QVERIFY(copy.empty());
+    QVERIFY(copy.begin() == copy.end());
+
+    test_map.clear();
+    QVERIFY(test_map.empty());
+    QVERIFY(test_map.find(keys.front()) == test_map.end());
+    QVERIFY(test_map.lower_bound(keys.front()) == test_map.end());
+}
+
+void splay_map_test::testArenaMap()
+{
+    using TestMap = bushy::arena_splay_map<int>;
+    using StandardMap = std::map<std::string, int>;
+
+    auto test_arena_map_equality = [](const TestMap& test_map, const StandardMap& standard_map)
+    {
+        QVERIFY(test_map.size() == standard_map.size());
+        QVERIFY(std::equal(test_map.cbegin(), test_map.cend(), standard_map.cbegin(), standard_map.cend(),
+                           [](const TestMap::value_type& left, const StandardMap::value_type& right) { return left.first.str() == right.first && left.second == right.second; }));
+    };
+
+    // Keys longer than the small string buffer, and some of the keys, which are prefixes of other keys
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3000; ++i)
+    {
+        keys.push_back("/var/lib/service/data/segment" + std::to_string(i % 100) + "/record" + std::to_string(i));
+        if (i % 100 == 0)
+        {
+            keys.push_back("/var/lib/service/data/segment" + std::to_string(i % 100));
+        }
+    }
+    keys.push_back(std::string());
+    keys.push_back(std::string(100000, 'x'));
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::minstd_rand engine(0);
+    std::shuffle(keys.begin(), keys.end(), engine);
+
+    TestMap test_map(4096);
+    StandardMap standard_map;
+
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        const auto result = test_map.insert(std::make_pair(keys[i], static_cast<int>(i)));
+        const auto standard_result = standard_map.insert(std::make_pair(keys[i], static_cast<int>(i)));
+        QVERIFY(result.second == standard_result.second);
+        QVERIFY(result.first->first.str() == standard_result.first->first);
+
+        if (result.second)
+        {
+            bytes += keys[i].size();
+        }
+    }
+
+    test_arena_map_equality(test_map, standard_map);
+    QVERIFY(test_map.arena().used() == bytes);
+    QVERIFY(test_map.garbage() == 0);
+
+    // Heterogeneous lookup
+    for (const std::string& key : keys)
+    {
+        QVERIFY(test_map.count(key) == 1);
+        QVERIFY(test_map.find(key.c_str()) != test_map.end());
+        QVERIFY(test_map.find(key)->second == standard_map.find(key)->second);
+        QVERIFY(test_map.at(key) == standard_map.at(key));
+
+        const std::string extended = key + "~";
+        QVERIFY(test_map.count(extended) == 0);
+        QVERIFY((test_map.lower_bound(extended) == test_map.end()) == (standard_map.lower_bound(extended) == standard_map.end()));
+        QVERIFY((test_map.upper_bound(key) == test_map.end()) == (standard_map.upper_bound(key) == standard_map.end()));
+    }
+
+#ifdef BUSHY_HAS_STRING_VIEW
+    QVERIFY(test_map.find(std::string_view(keys.front())) != test_map.end());
+    QVERIFY(test_map.find(std::string_view("not in the map")) == test_map.end());
+#endif
+
+    test_map["/new/key/inserted/by/operator/access"] = 7;
+    standard_map["/new/key/inserted/by/operator/access"] = 7;
+    QVERIFY(test_map.insert_or_assign(keys.back(), -1).second == false);
+    standard_map[keys.back()] = -1;
+    bytes += std::strlen("/new/key/inserted/by/operator/access");
+
+    test_arena_map_equality(test_map, standard_map);
+
+    // Erase half of the keys, the arena bytes become garbage
+    std::size_t erased_bytes = 0;
+    for (std::size_t i = 0; i < keys.size(); i += 2)
+    {
+        if (i % 4 == 0)
+        {
+            QVERIFY(test_map.erase(keys[i]) == 1);
+        }
+        else
+        {
+            test_map.erase(test_map.find(keys[i]));
+        }
+
+        standard_map.erase(keys[i]);
+        erased_bytes += keys[i].size();
+    }
+
+    test_arena_map_equality(test_map, standard_map);
+    QVERIFY(test_map.garbage() == erased_bytes);
+
+    // Copy stores only the used keys
+    TestMap copy(test_map);
+    test_arena_map_equality(copy, standard_map);
+    QVERIFY(copy.arena().used() == bytes - erased_bytes);
+    QVERIFY(copy.garbage() == 0);
+
+    // Compaction reclaims the garbage and keeps the map
+    const std::size_t reserved = test_map.arena().reserved();
+    test_map.compact();
+    test_arena_map_equality(test_map, standard_map);
+    QVERIFY(test_map.garbage() == 0);
+    QVERIFY(test_map.arena().used() == bytes - erased_bytes);
+    QVERIFY(test_map.arena().reserved() < reserved);
+
+    for (std::size_t i = 1; i < keys.size(); i += 2)
+    {
+        QVERIFY(test_map.find(keys[i]) != test_map.end());
+    }
+
+    // Clear releases the arena
+    test_map.clear();
+    QVERIFY(test_map.empty());
+    QVERIFY(test_map.arena().reserved() == 0);
+    test_arena_map_equality(copy, standard_map);
+
+    // Erased nodes left in the tree must not survive the compaction (their keys
+    // would point into the released arena)
+    using TombstoneMap = bushy::arena_splay_map<int, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::TOMBSTONE>>;
+
+    TombstoneMap tombstone_map(256);
+    for (int i = 0; i < 40; ++i)
+    {
+        tombstone_map.insert(std::make_pair(keys[i], i));
+    }
+
+    QVERIFY(tombstone_map.erase(keys[7]) == 1);
+    tombstone_map.compact();
+    QVERIFY(tombstone_map.size() == 39);
+    QVERIFY(tombstone_map.garbage() == 0);
+
+    for (int i = 0; i < 40; ++i)
+    {
+        QVERIFY(tombstone_map.count(keys[i]) == (i == 7 ? 0 : 1));
+    }
+
+    QVERIFY(tombstone_map.insert(std::make_pair(keys[7], 7)).second);
+    QVERIFY(tombstone_map.find(keys[7])->second == 7);
+}
+
+void splay_map_test::testMemoryResource()
+{
+#ifdef BUSHY_HAS_MEMORY_RESOURCE
+    using TestMap = bushy::pmr::splay_map<int, std::pmr::string>;
+    using StandardMap = std::map<int, std::pmr::string>;
+
+    auto test_resource = [](const TestMap& map, std::pmr::memory_resource* resource)
+    {
+        QVERIFY(map.get_allocator().resource() == resource);
+        for (const auto& item : map)
+        {
+            // Values are constructed using the allocator of the map
+            QVERIFY(item.second.get_allocator().resource() == resource);
+        }
+    };
+
+    auto test_equality = [](const TestMap& map, const StandardMap& standard_map)
+    {
+        QVERIFY(map.size() == standard_map.size());
+        QVERIFY(std::equal(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend(),
+                           [](const TestMap::value_type& left, const StandardMap::value_type& right) { return left.first == right.first && left.second == right.second; }));
+    };
+
+    std::pmr::monotonic_buffer_resource monotonic;
+    std::pmr::unsynchronized_pool_resource pool;
+
+    StandardMap standard_map;
+    TestMap map(&monotonic);
+    for (int i = 0; i < 1000; ++i)
+    {
+        const std::string value = "value of the key number " + std::to_string(i);
+        map.emplace(i, value.c_str());
+        standard_map.emplace(i, value.c_str());
+    }
+
+    for (int i = 0; i < 1000; i += 3)
+    {
+        map.erase(i);
+        standard_map.erase(i);
+    }
+
+    test_equality(map, standard_map);
+    test_resource(map, &monotonic);
+
+    // Copy construction uses the default resource
+    TestMap copy(map);
+    test_equality(copy, standard_map);
+    test_resource(copy, std::pmr::get_default_resource());
+
+    // Copy construction with allocator
+    TestMap pool_copy(map, &pool);
+    test_equality(pool_copy, standard_map);
+    test_resource(pool_copy, &pool);
+
+    // Copy assignment does not propagate the allocator
+    pool_copy.clear();
+    pool_copy = map;
+    test_equality(pool_copy, standard_map);
+    test_resource(pool_copy, &pool);
+
+    // Move construction takes the allocator
+    TestMap moved(std::move(copy));
+    test_equality(moved, standard_map);
+    test_resource(moved, std::pmr::get_default_resource());
+    QVERIFY(copy.empty());
+
+    // Move construction with different allocator moves the elements one by one
+    TestMap pool_moved(std::move(moved), &pool);
+    test_equality(pool_moved, standard_map);
+    test_resource(pool_moved, &pool);
+
+    // Move assignment with different allocator moves the elements one by one
+    TestMap monotonic_map(&monotonic);
+    monotonic_map = std::move(pool_moved);
+    test_equality(monotonic_map, standard_map);
+    test_resource(monotonic_map, &monotonic);
+
+    // Move assignment with equal allocator moves the tree
+    TestMap other_pool_map(&pool);
+    other_pool_map = std::move(pool_copy);
+    test_equality(other_pool_map, standard_map);
+    test_resource(other_pool_map, &pool);
+    QVERIFY(pool_copy.empty());
+
+    // Batch operations
+    std::vector<std::pair<int, std::pmr::string>> batch;
+    for (int i = 0; i < 1000; i += 3)
+    {
+        batch.emplace_back(i, "batch");
+        standard_map.emplace(i, "batch");
+    }
+
+    other_pool_map.insert_batch(batch.cbegin(), batch.cend());
+    test_equality(other_pool_map, standard_map);
+    test_resource(other_pool_map, &pool);
+#endif
+}
+
+// Value, which counts its living instances
+struct counted_value
+{
+    counted_value() { ++alive; }
+    counted_value(const counted_value&) { ++alive; }
+    ~counted_value() { --alive; }
+
+    static int alive;
+};
+
+int counted_value::alive = 0;
+
+#ifdef BUSHY_HAS_MEMORY_RESOURCE
+// Monotonic buffer resource, which counts the deallocations
+class counting_monotonic_resource : public std::pmr::monotonic_buffer_resource
+{
+public:
+    int deallocations = 0;
+
+protected:
+    virtual void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        ++deallocations;
+        std::pmr::monotonic_buffer_resource::do_deallocate(p, bytes, alignment);
+    }
+};
+#endif
+
+void splay_map_test::testClear()
+{
+    {
+        // Degenerated tree (long left spine, each node has right leaf), which is deeper
+        // than the stack used in the destruction of the tree.
+        using TestMap = bushy::splay_classic_map<int, counted_value>;
+
+        TestMap map;
+        for (int i = 1000; i > 0; i -= 2)
+        {
+            map.emplace(i, counted_value());
+            map.emplace(i + 1, counted_value());
+        }
+
+        QVERIFY(counted_value::alive == 1000);
+        map.clear();
+        QVERIFY(counted_value::alive == 0);
+        QVERIFY(map.empty());
+        QVERIFY(map.begin() == map.end());
+
+        map.emplace(1, counted_value());
+        QVERIFY(map.size() == 1);
+        QVERIFY(map.begin()->first == 1);
+    }
+
+    QVERIFY(counted_value::alive == 0);
+
+#ifdef BUSHY_HAS_MEMORY_RESOURCE
+    {
+        std::pmr::unsynchronized_pool_resource pool;
+        std::pmr::monotonic_buffer_resource monotonic;
+        QVERIFY(bushy::allocator_bulk_release<std::pmr::polymorphic_allocator<int>>::is_bulk(&monotonic));
+        QVERIFY(!bushy::allocator_bulk_release<std::pmr::polymorphic_allocator<int>>::is_bulk(&pool));
+        QVERIFY(!bushy::allocator_bulk_release<std::allocator<int>>::is_bulk(std::allocator<int>()));
+    }
+
+    {
+        // Trivially destructible values and monotonic buffer - nodes are not deallocated
+        counting_monotonic_resource resource;
+        bushy::pmr::splay_map<int, int> map(&resource);
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            map[i] = i;
+        }
+
+        map.clear();
+        QVERIFY(resource.deallocations == 0);
+        QVERIFY(map.empty());
+        QVERIFY(map.begin() == map.end());
+        QVERIFY(map.find(5) == map.end());
+
+        map[5] = 7;
+        QVERIFY(map.size() == 1);
+        QVERIFY(map.at(5) == 7);
+    }
+
+    {
+        // Values with destructor are destroyed
+        counting_monotonic_resource resource;
+        {
+            bushy::pmr::splay_map<int, counted_value> map(&resource);
+            for (int i = 0; i < 1000; ++i)
+            {
+                map.emplace(i, counted_value());
+            }
+
+            QVERIFY(counted_value::alive == 1000);
+        }
+
+        QVERIFY(counted_value::alive == 0);
+        QVERIFY(resource.deallocations == 1000);
+    }
+#endif
+}
+
+void splay_map_test::testThreadCachedAllocator()
+{
+    using TestMap = bushy::splay_map<int, std::string, std::less<int>, bushy::thread_cached_allocator<std::pair<const int, std::string>>>;
+    using StandardMap = std::map<int, std::string>;
+
+    auto fill = [](TestMap& map, StandardMap& standard_map, int seed)
+    {
+        std::minstd_rand engine(seed);
+        std::uniform_int_distribution<int> distribution(0, 5000);
+
+        // Churn - insertions and erases
+        for (int i = 0; i < 20000; ++i)
+        {
+            const int key = distribution(engine);
+            if (i % 3 == 2)
+            {
+                map.erase(key);
+                standard_map.erase(key);
+            }
+            else
+            {
+                map.emplace(key, std::to_string(key));
+                standard_map.emplace(key, std::to_string(key));
+            }
+        }
+    };
+
+    {
+        // Single thread
+        TestMap map;
+        StandardMap standard_map;
+        fill(map, standard_map, 0);
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+    }
+
+    {
+        // Maps are created in other threads, and they are destroyed in this thread
+        std::vector<TestMap> maps(4);
+        std::vector<StandardMap> standard_maps(4);
+        std::vector<std::thread> threads;
+
+        for (std::size_t i = 0; i < maps.size(); ++i)
+        {
+            threads.emplace_back([&, i]() { fill(maps[i], standard_maps[i], static_cast<int>(i)); });
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (std::size_t i = 0; i < maps.size(); ++i)
+        {
+            QVERIFY(is_range_equals(maps[i].cbegin(), maps[i].cend(), standard_maps[i].cbegin(), standard_maps[i].cend()));
+        }
+
+        // Map created in this thread is destroyed in the other thread
+        TestMap map;
+        StandardMap standard_map;
+        fill(map, standard_map, 42);
+
+        std::thread destroyer([&map]() { TestMap moved(std::move(map)); moved.clear(); });
+        destroyer.join();
+        QVERIFY(map.empty());
+
+        standard_map.clear();
+        fill(map, standard_map, 43);
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+    }
+
+    {
+        // Map destroyed after the cache of its thread (as static objects are destroyed
+        // after the thread local objects of the main thread) uses the shared pool
+        struct late_map
+        {
+            TestMap map;
+            std::size_t* result = nullptr;
+
+            ~late_map()
+            {
+                map.erase(map.begin());
+                map.emplace(-1, "allocated after the cache");
+                *result = map.size();
+            }
+        };
+
+        std::size_t result = 0;
+        std::thread thread([&result, &fill]()
+        {
+            // Map is constructed before the cache, so it is destroyed after the cache
+            static thread_local late_map late;
+            late.result = &result;
+
+            StandardMap standard_map;
+            fill(late.map, standard_map, 7);
+        });
+        thread.join();
+        QVERIFY(result > 0);
+
+        TestMap map;
+        StandardMap standard_map;
+        fill(map, standard_map, 8);
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+    }
+
+    {
+        // Arrays use the global allocator
+        bushy::thread_cached_allocator<int> allocator;
+        int* array = allocator.allocate(16);
+        std::fill(array, array + 16, 1);
+        allocator.deallocate(array, 16);
+        QVERIFY(allocator == bushy::thread_cached_allocator<double>());
+    }
+}
+
+void splay_map_test::testHugePageAllocator()
+{
+    using TestMap = bushy::splay_map<int, std::string, std::less<int>, bushy::huge_page_allocator<std::pair<const int, std::string>>>;
+    using StandardMap = std::map<int, std::string>;
+
+    bushy::huge_page_arena arena;
+    TestMap map(&arena);
+    StandardMap standard_map;
+
+    std::minstd_rand engine(0);
+    std::uniform_int_distribution<int> distribution(0, 100000);
+
+    for (int i = 0; i < 50000; ++i)
+    {
+        const int key = distribution(engine);
+        map.emplace(key, std::to_string(key));
+        standard_map.emplace(key, std::to_string(key));
+    }
+
+    QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+    QVERIFY(arena.reserved() >= bushy::huge_page_arena::default_chunk_size);
+
+    // Erased nodes are reused, so churn doesn't reserve more memory
+    const std::size_t reserved = arena.reserved();
+    for (int i = 0; i < 100000; ++i)
+    {
+        const int key = distribution(engine);
+        if (map.erase(key))
+        {
+            standard_map.erase(key);
+            map.emplace(key + 100000, std::to_string(key));
+            standard_map.emplace(key + 100000, std::to_string(key));
+        }
+    }
+
+    QVERIFY(arena.reserved() == reserved);
+    QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+
+    // Copy uses the same arena
+    TestMap copy(map);
+    QVERIFY(copy.get_allocator() == map.get_allocator());
+    QVERIFY(is_range_equals(copy.cbegin(), copy.cend(), standard_map.cbegin(), standard_map.cend()));
+
+    // Allocations larger, than the chunk
+    bushy::huge_page_arena small_arena(1);
+    bushy::huge_page_allocator<char> allocator(&small_arena);
+    char* small = allocator.allocate(16);
+    char* large = allocator.allocate(3 * bushy::huge_page_arena::huge_page_size);
+    std::fill(large, large + 3 * bushy::huge_page_arena::huge_page_size, 'a');
+    allocator.deallocate(large, 3 * bushy::huge_page_arena::huge_page_size);
+    allocator.deallocate(small, 16);
+    QVERIFY(allocator.allocate(16) == small);
+    QVERIFY(small_arena.reserved() >= 4 * bushy::huge_page_arena::huge_page_size);
+
+    // Over-aligned allocations
+    bushy::huge_page_allocator<std::max_align_t> aligned_allocator(allocator);
+    for (int i = 0; i < 100; ++i)
+    {
+        allocator.allocate(1);
+        std::max_align_t* pointer = aligned_allocator.allocate(1);
+        QVERIFY(reinterpret_cast<std::uintptr_t>(pointer) % alignof(std::max_align_t) == 0);
+    }
+}
+
+void splay_map_test::testSharedNodePool()
+{
+    using TestMap = bushy::splay_map<int, int, std::less<int>, bushy::shared_pool_allocator<std::pair<const int, int>>>;
+    using StandardMap = std::map<int, int>;
+
+    bushy::shared_node_pool pool(4096, 4);
+
+    {
+        // Many maps sharing the pool
+        std::vector<TestMap> maps;
+        std::vector<StandardMap> standard_maps(100);
+        for (std::size_t i = 0; i < standard_maps.size(); ++i)
+        {
+            maps.emplace_back(&pool);
+        }
+
+        std::minstd_rand engine(0);
+        std::uniform_int_distribution<int> distribution(0, 1000);
+        for (int i = 0; i < 100000; ++i)
+        {
+            const std::size_t index = static_cast<std::size_t>(i) % maps.size();
+            const int key = distribution(engine);
+            if (i % 3 == 2)
+            {
+                maps[index].erase(key);
+                standard_maps[index].erase(key);
+            }
+            else
+            {
+                maps[index].insert(std::make_pair(key, i));
+                standard_maps[index].insert(std::make_pair(key, i));
+            }
+        }
+
+        std::size_t usage = 0;
+        for (std::size_t i = 0; i < maps.size(); ++i)
+        {
+            QVERIFY(is_range_equals(maps[i].cbegin(), maps[i].cend(), standard_maps[i].cbegin(), standard_maps[i].cend()));
+            QVERIFY(maps[i].get_allocator().usage() >= maps[i].size() * sizeof(std::pair<const int, int>));
+            QVERIFY(maps[i].memory_consumption() == TestMap::memory_consumption_empty() + maps[i].get_allocator().usage());
+            usage += maps[i].get_allocator().usage();
+        }
+        QVERIFY(pool.used() == usage);
+        QVERIFY(pool.reserved() >= usage);
+
+        // Copy of the map has its own usage
+        TestMap copy(maps.front());
+        QVERIFY(copy.get_allocator() == maps.front().get_allocator());
+        QVERIFY(copy.get_allocator().usage() == maps.front().get_allocator().usage());
+        QVERIFY(pool.used() == 2 * copy.get_allocator().usage() + usage - copy.get_allocator().usage());
+
+        // Swap moves the usage with the nodes
+        TestMap other(&pool);
+        other.insert(std::make_pair(1, 1));
+        const std::size_t other_usage = other.get_allocator().usage();
+        copy.swap(other);
+        QVERIFY(copy.size() == 1 && copy.get_allocator().usage() == other_usage);
+        QVERIFY(other.get_allocator().usage() == maps.front().get_allocator().usage());
+
+        // Move takes the usage with the nodes, moved-from map counts only its new nodes
+        TestMap source(&pool);
+        for (int i = 0; i < 100; ++i)
+        {
+            source.insert(std::make_pair(i, i));
+        }
+        const unsigned long long source_consumption = source.memory_consumption();
+
+        TestMap target(std::move(source));
+        QVERIFY(target.memory_consumption() == source_consumption);
+        QVERIFY(source.memory_consumption() == TestMap::memory_consumption_empty());
+
+        for (int i = 0; i < 100; ++i)
+        {
+            source.insert(std::make_pair(i, i));
+        }
+        QVERIFY(source.memory_consumption() == source_consumption);
+        QVERIFY(target.memory_consumption() == source_consumption);
+
+        target.clear();
+        QVERIFY(target.memory_consumption() == TestMap::memory_consumption_empty());
+        QVERIFY(source.memory_consumption() == source_consumption);
+
+        // Move assignment and move with the allocator behave the same way
+        target = std::move(source);
+        QVERIFY(target.memory_consumption() == source_consumption);
+        QVERIFY(source.memory_consumption() == TestMap::memory_consumption_empty());
+
+        TestMap extended(std::move(target), target.get_allocator());
+        QVERIFY(extended.memory_consumption() == source_consumption);
+        QVERIFY(target.memory_consumption() == TestMap::memory_consumption_empty());
+    }
+
+    // Empty slabs are returned (only one spare slab per stripe is kept)
+    QVERIFY(pool.used() == 0);
+    QVERIFY(pool.slab_count() <= 4);
+
+    {
+        // Maps of many threads, destroyed on the other thread
+        std::vector<TestMap> maps;
+        for (int i = 0; i < 4; ++i)
+        {
+            maps.emplace_back(&pool);
+        }
+
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < maps.size(); ++i)
+        {
+            threads.emplace_back([&maps, i]()
+            {
+                for (int j = 0; j < 20000; ++j)
+                {
+                    maps[i].insert(std::make_pair(j, j));
+                    if (j % 2)
+                    {
+                        maps[i].erase(j / 2);
+                    }
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (const TestMap& map : maps)
+        {
+            QVERIFY(map.size() == 10000);
+        }
+    }
+
+    QVERIFY(pool.used() == 0);
+    QVERIFY(pool.slab_count() <= 4);
+}
+
+// Compares the struct-of-arrays map with the standard map (in both directions)
+template<typename SoaMap, typename StandardMap>
+static bool is_soa_map_equal(const SoaMap& soa_map, const StandardMap& standard_map)
+{
+    if (soa_map.size() != standard_map.size())
+    {
+        return false;
+    }
+
+    auto it = soa_map.cbegin();
+    for (const auto& item : standard_map)
+    {
+        if (it == soa_map.cend() || it->first != item.first || it->second != item.second)
+        {
+            return false;
+        }
+        ++it;
+    }
+
+    auto rit = soa_map.cend();
+    for (auto standard_it = standard_map.crbegin(); standard_it != standard_map.crend(); ++standard_it)
+    {
+        --rit;
+        if (rit->first != standard_it->first)
+        {
+            return false;
+        }
+    }
+
+    return it == soa_map.cend() && rit == soa_map.cbegin();
+}
+
+template<typename Policy>
+static void test_soa_map()
+{
+    using TestMap = bushy::splay_soa_map<int, std::string, std::less<int>, Policy>;
+    using StandardMap = std::map<int, std::string>;
+
+    TestMap map;
+    StandardMap standard_map;
+    QVERIFY(map.empty() && map.begin() == map.end());
+
+    std::minstd_rand engine(0);
+    std::uniform_int_distribution<int> distribution(0, 2000);
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        const int key = distribution(engine);
+        switch (i % 6)
+        {
+            case 0:
+                QVERIFY(map.insert(std::make_pair(key, std::to_string(i))).second == standard_map.insert(std::make_pair(key, std::to_string(i))).second);
+                break;
+
+            case 1:
+                QVERIFY(map.emplace(key, std::to_string(i)).second == standard_map.emplace(key, std::to_string(i)).second);
+                break;
+
+            case 2:
+                map[key] = std::to_string(i);
+                standard_map[key] = std::to_string(i);
+                break;
+
+            case 3:
+                QVERIFY(map.erase(key) == standard_map.erase(key));
+                break;
+
+            case 4:
+            {
+                auto it = map.lower_bound(key);
+                auto standard_it = standard_map.lower_bound(key);
+                QVERIFY((it == map.end()) == (standard_it == standard_map.end()));
+                if (it != map.end())
+                {
+                    QVERIFY(it->first == standard_it->first);
+                    it = map.erase(it);
+                    standard_it = standard_map.erase(standard_it);
+                    QVERIFY((it == map.end()) == (standard_it == standard_map.end()));
+                    QVERIFY(it == map.end() || it->first == standard_it->first);
+                }
+                break;
+            }
+
+            case 5:
+            {
+                auto it = map.upper_bound(key);
+                auto standard_it = standard_map.upper_bound(key);
+                QVERIFY((it == map.end()) == (standard_it == standard_map.end()));
+                QVERIFY(it == map.end() || it->first == standard_it->first);
+                QVERIFY(map.count(key) == standard_map.count(key));
+                QVERIFY((map.find(key) == map.end()) == (standard_map.find(key) == standard_map.end()));
+                break;
+            }
+        }
+    }
+
+    QVERIFY(is_soa_map_equal(map, standard_map));
+
+    // Element access
+    const int first_key = standard_map.begin()->first;
+    QVERIFY(map.at(first_key) == standard_map.at(first_key));
+    map.insert_or_assign(first_key, "assigned");
+    standard_map.insert_or_assign(first_key, "assigned");
+    QVERIFY(static_cast<const TestMap&>(map).at(first_key) == "assigned");
+
+    bool exception_thrown = false;
+    try
+    {
+        map.at(-1);
+    }
+    catch (std::out_of_range)
+    {
+        exception_thrown = true;
+    }
+    QVERIFY(exception_thrown);
+
+    // Copy and move
+    TestMap copy(map);
+    QVERIFY(is_soa_map_equal(copy, standard_map));
+    TestMap moved(std::move(copy));
+    QVERIFY(copy.empty() && is_soa_map_equal(moved, standard_map));
+    copy = { { 1, "a" }, { 2, "b" } };
+    copy.swap(moved);
+    QVERIFY(moved.size() == 2 && is_soa_map_equal(copy, standard_map));
+
+    // Erase all elements by iterators
+    for (auto it = map.begin(); it != map.end();)
+    {
+        it = map.erase(it);
+    }
+    QVERIFY(map.empty() && map.begin() == map.end());
+}
+
+void splay_map_test::testSoaMap()
+{
+    test_soa_map<bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD>>();
+    test_soa_map<bushy::splay_map_policy<bushy::splay_mode::ALWAYS, bushy::splay_mode::ALWAYS>>();
+
+    // Search touches only the keys and links, memory of the node is small
+    bushy::splay_soa_map<int, int> map;
+    map.reserve(1000);
+    QVERIFY(map.memory_consumption() >= 1000 * (2 * sizeof(int) + 3 * sizeof(std::uint32_t)));
+}
+
+void splay_map_test::testPrefetch()
+{
+    using PrefetchPolicy = bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::CHILDREN>;
+    static_assert(bushy::impl::policy_prefetch<PrefetchPolicy>::value == bushy::prefetch_mode::CHILDREN, "Prefetch must be enabled!");
+    static_assert(bushy::impl::policy_prefetch<bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::ALWAYS>>::value == bushy::prefetch_mode::NONE, "Prefetch must be disabled!");
+
+    // Prefetching must not change the behaviour of the searches and iteration
+    {
+        using TestMap = bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, PrefetchPolicy>;
+        using StandardMap = std::map<int, int>;
+
+        TestMap test_map;
+        StandardMap standard_map;
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            const int key = (i * 37) % 1009;
+            test_map.insert(std::make_pair(key, i));
+            standard_map.insert(std::make_pair(key, i));
+        }
+
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+        for (int key = -1; key < 1012; key += 3)
+        {
+            test_iterator_equal(test_map.find(key), standard_map.find(key), test_map.cend(), standard_map.cend());
+            test_iterator_equal(test_map.lower_bound(key), standard_map.lower_bound(key), test_map.cend(), standard_map.cend());
+            test_iterator_equal(test_map.upper_bound(key), standard_map.upper_bound(key), test_map.cend(), standard_map.cend());
+            QVERIFY(test_map.erase(key) == standard_map.erase(key));
+        }
+
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+        QVERIFY(std::equal(test_map.crbegin(), test_map.crend(), standard_map.crbegin(), standard_map.crend()));
+    }
+
+    {
+        using TestMap = bushy::splay_map<std::string, int, std::less<std::string>, std::allocator<std::pair<const std::string, int>>, PrefetchPolicy>;
+        using StandardMap = std::map<std::string, int>;
+
+        TestMap test_map;
+        StandardMap standard_map;
+
+        for (int i = 0; i < 200; ++i)
+        {
+            const std::string key = std::to_string((i * 13) % 211);
+            test_map.emplace(key, i);
+            standard_map.emplace(key, i);
+        }
+
+        test_map_equality<TestMap, StandardMap>(test_map, standard_map);
+
+        for (int i = 0; i < 220; i += 5)
+        {
+            const std::string key = std::to_string(i);
+            test_iterator_equal(test_map.find(key), standard_map.find(key), test_map.cend(), standard_map.cend());
+            test_iterator_equal(test_map.lower_bound(key), standard_map.lower_bound(key), test_map.cend(), standard_map.cend());
+            test_iterator_equal(test_map.upper_bound(key), standard_map.upper_bound(key), test_map.cend(), standard_map.cend());
+        }
+    }
+}
+
+// Fills the map with aligned nodes and checks, that all nodes are aligned. Value
+// of the pair<const int, int> follows the links of the node.
+template<typename Map, std::size_t Alignment>
+static void test_node_alignment(Map& map)
+{
+    static_assert(Map::memory_consumption_item() == Alignment, "Node must be padded to the alignment!");
+
+    using StandardMap = std::map<int, int>;
+    StandardMap standard_map;
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        const int key = (i * 37) % 1999;
+        if (i % 4 == 3)
+        {
+            QVERIFY(map.erase(key) == standard_map.erase(key));
+        }
+        else
+        {
+            map.insert(std::make_pair(key, i));
+            standard_map.insert(std::make_pair(key, i));
+        }
+    }
+
+    test_map_equality<Map, StandardMap>(map, standard_map);
+
+    for (const auto& item : map)
+    {
+        const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(&item) - 3 * sizeof(void*);
+        QVERIFY(address % Alignment == 0);
+    }
+}
+
+void splay_map_test::testNodeAlignment()
+{
+    using Value = std::pair<const int, int>;
+    using HalfLinePolicy = bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::HALF_LINE>;
+    using CacheLinePolicy = bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::CACHE_LINE>;
+
+    static_assert(bushy::impl::policy_alignment<HalfLinePolicy>::value == 32, "Invalid node alignment!");
+    static_assert(bushy::impl::policy_alignment<CacheLinePolicy>::value == 64, "Invalid node alignment!");
+    static_assert(bushy::splay_map<int, int>::memory_consumption_item() == 3 * sizeof(void*) + sizeof(Value), "Natural node must not be padded!");
+
+#ifdef __cpp_aligned_new
+    {
+        bushy::splay_map<int, int, std::less<int>, std::allocator<Value>, CacheLinePolicy> map;
+        test_node_alignment<decltype(map), 64>(map);
+    }
+#endif
+
+    {
+        bushy::splay_map<int, int, std::less<int>, bushy::thread_cached_allocator<Value>, CacheLinePolicy> map;
+        test_node_alignment<decltype(map), 64>(map);
+    }
+
+    {
+        bushy::huge_page_arena arena;
+        bushy::splay_map<int, int, std::less<int>, bushy::huge_page_allocator<Value>, HalfLinePolicy> map(&arena);
+        test_node_alignment<decltype(map), 32>(map);
+    }
+
+    {
+        bushy::shared_node_pool pool(4096, 2);
+        bushy::splay_map<int, int, std::less<int>, bushy::shared_pool_allocator<Value>, CacheLinePolicy> map(&pool);
+        test_node_alignment<decltype(map), 64>(map);
+        QVERIFY(map.memory_consumption() == decltype(map)::memory_consumption_empty() + map.size() * 64);
+    }
+}
+
+// Moves the cursor over the keys in small steps and searches each key from
+// the previous result, results must be same as ordinary searches.
+template<typename Map>
+static void test_hinted_search()
+{
+    using StandardMap = std::map<int, int>;
+
+    Map map;
+    StandardMap standard_map;
+
+    // Hinted searches in the empty map
+    QVERIFY(map.find(map.cend(), 5) == map.cend());
+    QVERIFY(map.lower_bound(map.cend(), 5) == map.cend());
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        const int key = ((i * 37) % 1009) * 2;
+        map.insert(std::make_pair(key, i));
+        standard_map.insert(std::make_pair(key, i));
+    }
+
+    std::minstd_rand engine(0);
+    std::uniform_int_distribution<int> step(-20, 20);
+
+    typename Map::const_iterator cursor = map.cend();
+    int key = 1000;
+    for (int i = 0; i < 5000; ++i)
+    {
+        key += step(engine);
+
+        test_iterator_equal(map.find(cursor, key), standard_map.find(key), map.cend(), standard_map.cend());
+        test_iterator_equal(map.lower_bound(cursor, key), standard_map.lower_bound(key), map.cend(), standard_map.cend());
+
+        cursor = map.lower_bound(cursor, key);
+    }
+
+    // Far keys and the end hint
+    for (const int far_key : { -100, 0, 1, 1000, 2016, 2017, 5000 })
+    {
+        test_iterator_equal(map.find(map.cbegin(), far_key), standard_map.find(far_key), map.cend(), standard_map.cend());
+        test_iterator_equal(map.find(map.cend(), far_key), standard_map.find(far_key), map.cend(), standard_map.cend());
+        test_iterator_equal(map.lower_bound(map.cbegin(), far_key), standard_map.lower_bound(far_key), map.cend(), standard_map.cend());
+        test_iterator_equal(map.lower_bound(map.cend(), far_key), standard_map.lower_bound(far_key), map.cend(), standard_map.cend());
+    }
+
+    test_map_equality<Map, StandardMap>(map, standard_map);
+
+    // Found iterator can be used to modify the value
+    typename Map::iterator it = map.find(map.cbegin(), 2);
+    QVERIFY(it != map.end() && it->first == 2);
+    it->second = -1;
+    QVERIFY(map.at(2) == -1);
+}
+
+void splay_map_test::testHintedSearch()
+{
+    test_hinted_search<bushy::splay_map<int, int>>();
+    test_hinted_search<bushy::splay_classic_map<int, int>>();
+    test_hinted_search<bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::NEVER>>>();
+}
+
+// Comparator, which counts the comparisons
+static std::size_t counted_comparisons = 0;
+
+struct counting_less
+{
+    bool operator()(int l, int r) const
+    {
+        ++counted_comparisons;
+        return l < r;
+    }
+};
+
+void splay_map_test::testInsertHintValidation()
+{
+    using TestMap = bushy::splay_map<int, int, counting_less>;
+    using StandardMap = std::map<int, int>;
+
+    // Correct hints are validated with constant count of comparisons
+    {
+        TestMap map;
+
+        counted_comparisons = 0;
+        for (int i = 0; i < 10000; ++i)
+        {
+            map.emplace_hint(map.cend(), i, i);
+        }
+        QVERIFY(map.size() == 10000);
+        QVERIFY(counted_comparisons <= 2 * 10000);
+
+        // Hint after which the key belongs (result of the previous insertion)
+        TestMap::iterator hint = map.begin();
+        counted_comparisons = 0;
+        for (int i = 10000; i < 20000; ++i)
+        {
+            hint = map.insert(hint, std::make_pair(i, i));
+        }
+        QVERIFY(map.size() == 20000);
+        QVERIFY(counted_comparisons <= 4 * 10000);
+
+        // Hint before which the key belongs
+        TestMap reverse_map;
+        TestMap::iterator reverse_hint = reverse_map.end();
+        counted_comparisons = 0;
+        for (int i = 10000; i > 0; --i)
+        {
+            reverse_hint = reverse_map.try_emplace(reverse_hint, i, i);
+        }
+        QVERIFY(reverse_map.size() == 10000);
+        QVERIFY(counted_comparisons <= 4 * 10000);
+        QVERIFY(std::is_sorted(reverse_map.cbegin(), reverse_map.cend()));
+    }
+
+    // Hints off by a little, random hints and existing keys
+    {
+        TestMap map;
+        StandardMap standard_map;
+
+        std::minstd_rand engine(0);
+        std::uniform_int_distribution<int> distribution(0, 3000);
+        std::uniform_int_distribution<int> offset(-3, 3);
+
+        TestMap::iterator hint = map.end();
+        for (int i = 0; i < 20000; ++i)
+        {
+            const int key = (i % 4 == 0) ? distribution(engine) : std::max(0, (hint != map.end() ? hint->first : 1500) + offset(engine));
+
+            switch (i % 4)
+            {
+                case 0:
+                    hint = map.insert(hint, std::make_pair(key, i));
+                    standard_map.insert(std::make_pair(key, i));
+                    break;
+
+                case 1:
+                    hint = map.emplace_hint(hint, key, i);
+                    standard_map.emplace(key, i);
+                    break;
+
+                case 2:
+                    hint = map.try_emplace(hint, key, i);
+                    standard_map.try_emplace(key, i);
+                    break;
+
+                case 3:
+                    hint = map.insert_or_assign(hint, key, i);
+                    standard_map.insert_or_assign(key, i);
+                    break;
+            }
+
+            QVERIFY(hint != map.end() && hint->first == key && hint->second == standard_map.at(key));
+        }
+
+        QVERIFY(map.size() == standard_map.size());
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+    }
+}
+
+void splay_map_test::testTopDownInsert()
+{
+    using TestMap = bushy::splay_map<int, int, counting_less, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::TOP_DOWN, bushy::splay_mode::NEVER>>;
+    using StandardMap = std::map<int, int>;
+
+    // Inserted key becomes the root, so it is found again with two comparisons
+    {
+        TestMap map;
+
+        std::minstd_rand engine(0);
+        std::uniform_int_distribution<int> distribution(0, 100000);
+
+        for (int i = 0; i < 10000; ++i)
+        {
+            const int key = distribution(engine);
+            map.insert(std::make_pair(key, i));
+
+            counted_comparisons = 0;
+            QVERIFY(!map.emplace(key, i).second);
+            QVERIFY(counted_comparisons <= 2);
+        }
+
+        QVERIFY(std::is_sorted(map.cbegin(), map.cend()));
+    }
+
+    // Random insertions (with duplicate keys) by all insertion functions without hint
+    {
+        TestMap map;
+        StandardMap standard_map;
+
+        std::minstd_rand engine(1);
+        std::uniform_int_distribution<int> distribution(0, 3000);
+
+        for (int i = 0; i < 20000; ++i)
+        {
+            const int key = distribution(engine);
+
+            switch (i % 5)
+            {
+                case 0:
+                    QVERIFY(map.insert(std::make_pair(key, i)).second == standard_map.insert(std::make_pair(key, i)).second);
+                    break;
+
+                case 1:
+                    QVERIFY(map.emplace(key, i).second == standard_map.emplace(key, i).second);
+                    break;
+
+                case 2:
+                    QVERIFY(map.try_emplace(key, i).second == standard_map.try_emplace(key, i).second);
+                    break;
+
+                case 3:
+                    QVERIFY(map.insert_or_assign(key, i).second == standard_map.insert_or_assign(key, i).second);
+                    break;
+
+                case 4:
+                    map[key] = i;
+                    standard_map[key] = i;
+                    break;
+            }
+
+            QVERIFY(map.size() == standard_map.size());
+        }
+
+        QVERIFY(map.cbegin()->first == standard_map.cbegin()->first);
+        QVERIFY(std::prev(map.cend())->first == std::prev(standard_map.cend())->first);
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+        QVERIFY(is_range_equals(map.crbegin(), map.crend(), standard_map.crbegin(), standard_map.crend()));
+
+        // Finds and erasures work on the restructured tree
+        for (int i = 0; i < 3000; i += 3)
+        {
+            QVERIFY((map.find(i) == map.end()) == (standard_map.find(i) == standard_map.end()));
+            QVERIFY(map.erase(i) == standard_map.erase(i));
+        }
+
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+    }
+}
+
+template<bushy::erase_mode Mode>
+static void test_erase_mode()
+{
+    using TestMap = bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, Mode>>;
+    using StandardMap = std::map<int, int>;
+
+    TestMap map;
+    StandardMap standard_map;
+
+    std::minstd_rand engine(0);
+    std::uniform_int_distribution<int> distribution(0, 2000);
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        const int key = distribution(engine);
+
+        switch (i % 4)
+        {
+            case 0:
+            case 1:
+                map.emplace(key, i);
+                standard_map.emplace(key, i);
+                break;
+
+            case 2:
+                QVERIFY(map.erase(key) == standard_map.erase(key));
+                break;
+
+            case 3:
+            {
+                typename TestMap::iterator it = map.lower_bound(key);
+                StandardMap::iterator standard_it = standard_map.lower_bound(key);
+                if (it != map.end())
+                {
+                    it = map.erase(it);
+                    standard_it = standard_map.erase(standard_it);
+                }
+                QVERIFY((it == map.end()) == (standard_it == standard_map.end()));
+                QVERIFY(it == map.end() || it->first == standard_it->first);
+                break;
+            }
+        }
+
+        QVERIFY(map.size() == standard_map.size());
+        if (!map.empty())
+        {
+            QVERIFY(map.cbegin()->first == standard_map.cbegin()->first);
+            QVERIFY(map.crbegin()->first == standard_map.crbegin()->first);
+        }
+    }
+
+    QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+    QVERIFY(is_range_equals(map.crbegin(), map.crend(), standard_map.crbegin(), standard_map.crend()));
+
+    // Erase the ranges and then everything, one by one
+    map.erase(map.find(map.cbegin()->first), map.lower_bound(500));
+    standard_map.erase(standard_map.cbegin(), standard_map.lower_bound(500));
+    map.erase(map.lower_bound(1500), map.cend());
+    standard_map.erase(standard_map.lower_bound(1500), standard_map.cend());
+    QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+
+    while (!map.empty())
+    {
+        map.erase(std::next(map.begin(), map.size() / 2));
+    }
+    QVERIFY(map.begin() == map.end());
+}
+
+void splay_map_test::testEraseMode()
+{
+    test_erase_mode<bushy::erase_mode::SPLAY>();
+    test_erase_mode<bushy::erase_mode::UNLINK>();
+    test_erase_mode<bushy::erase_mode::UNLINK_SPLAY_PARENT>();
+    test_erase_mode<bushy::erase_mode::TOMBSTONE>();
+
+    static_assert(bushy::impl::policy_erase<bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::ALWAYS>>::value == bushy::erase_mode::SPLAY, "Erased nodes must be splayed by default!");
+
+    // Unlinking does not restructure the tree - the chain of the sorted keys
+    // (nothing is splayed) stays the chain, the erased node is just removed.
+    using UnlinkMap = bushy::splay_map<int, int, counting_less, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::NEVER, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::UNLINK>>;
+    using SplayMap = bushy::splay_map<int, int, counting_less, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::NEVER>>;
+
+    UnlinkMap unlink_map;
+    SplayMap splay_map;
+    for (int i = 0; i < 1000; ++i)
+    {
+        unlink_map.emplace_hint(unlink_map.cend(), i, i);
+        splay_map.emplace_hint(splay_map.cend(), i, i);
+    }
+
+    QVERIFY(unlink_map.erase(500) == 1);
+    QVERIFY(splay_map.erase(500) == 1);
+
+    // First key is still the root of the chain, when the erased node was unlinked
+    counted_comparisons = 0;
+    QVERIFY(unlink_map.find(0) != unlink_map.end());
+    QVERIFY(counted_comparisons <= 2);
+
+    counted_comparisons = 0;
+    QVERIFY(splay_map.find(0) != splay_map.end());
+    QVERIFY(counted_comparisons > 2);
+}
+
+void splay_map_test::testTombstones()
+{
+    using TestMap = bushy::splay_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::FOURTH, bushy::splay_mode::THIRD, bushy::prefetch_mode::NONE, bushy::node_alignment::NATURAL, bushy::erase_mode::TOMBSTONE>>;
+    using StandardMap = std::map<int, int>;
+
+    TestMap map;
+    StandardMap standard_map;
+    for (int i = 0; i < 1000; ++i)
+    {
+        map.emplace(i, i);
+        standard_map.emplace(i, i);
+    }
+
+    // Erase every third element and the extremes, tombstones stay (less than half of the nodes),
+    // only the erased extremes (0, 999 and 998) are removed
+    for (int i = 0; i < 1000; i += 3)
+    {
+        QVERIFY(map.erase(i) == 1);
+        QVERIFY(map.erase(i) == 0);
+        standard_map.erase(i);
+    }
+    map.erase(std::prev(map.end()));
+    standard_map.erase(std::prev(standard_map.end()));
+
+    QVERIFY(map.size() == standard_map.size());
+    QVERIFY(map.memory_consumption() == map.memory_consumption_empty() + 997 * map.memory_consumption_item());
+    test_map_equality<TestMap, StandardMap>(map, standard_map);
+    QVERIFY(is_range_equals(map.crbegin(), map.crend(), standard_map.crbegin(), standard_map.crend()));
+    QVERIFY(map.front().first == 1 && map.back().first == 997);
+
+    // Lookups skip the tombstones
+    for (int i = -1; i < 1001; ++i)
+    {
+        QVERIFY(map.count(i) == standard_map.count(i));
+        QVERIFY((map.find(i) == map.end()) == (standard_map.find(i) == standard_map.end()));
+        QVERIFY(map.value(i, -1) == (standard_map.count(i) ? standard_map.at(i) : -1));
+
+        auto lower = map.lower_bound(i);
+        auto standard_lower = standard_map.lower_bound(i);
+        QVERIFY(lower == map.end() ? standard_lower == standard_map.end() : lower->first == standard_lower->first);
+
+        auto upper = map.upper_bound(i);
+        auto standard_upper = standard_map.upper_bound(i);
+        QVERIFY(upper == map.end() ? standard_upper == standard_map.end() : upper->first == standard_upper->first);
+    }
+
+    bool thrown = false;
+    try
+    {
+        map.at(300);
+    }
+    catch (const std::out_of_range&)
+    {
+        thrown = true;
+    }
+    QVERIFY(thrown);
+
+    int visited = 0;
+    map.for_each([&visited](const std::pair<const int, int>& item) { QVERIFY(item.first % 3 != 0); ++visited; });
+    QVERIFY(visited == static_cast<int>(standard_map.size()));
+
+    // Copy and move of the map with tombstones
+    TestMap copy(map);
+    test_map_equality<TestMap, StandardMap>(copy, standard_map);
+    TestMap moved(std::move(copy));
+    test_map_equality<TestMap, StandardMap>(moved, standard_map);
+    QVERIFY(copy.empty());
+
+    // Erased keys are inserted again (in place of the tombstones)
+    QVERIFY(map.insert(std::make_pair(0, 10)).second);
+    QVERIFY(map.emplace(3, 13).second);
+    QVERIFY(map.try_emplace(6, 16).second);
+    QVERIFY(map.insert_or_assign(9, 19).second);
+    map[12] = 22;
+    QVERIFY(map.emplace_hint(map.find(14), 15, 25)->second == 25);
+    QVERIFY(map.insert(map.end(), std::make_pair(999, 1009))->second == 1009);
+    for (const auto& item : { std::make_pair(0, 10), std::make_pair(3, 13), std::make_pair(6, 16), std::make_pair(9, 19), std::make_pair(12, 22), std::make_pair(15, 25), std::make_pair(999, 1009) })
+    {
+        standard_map.insert(item);
+    }
+    test_map_equality<TestMap, StandardMap>(map, standard_map);
+
+    // Erasing more than half of the nodes compacts the tree
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (i % 10 != 0)
+        {
+            map.erase(i);
+            standard_map.erase(i);
+        }
+    }
+    QVERIFY(map.memory_consumption() < 1000 * map.memory_consumption_item());
+    test_map_equality<TestMap, StandardMap>(map, standard_map);
+
+    // Bulk operations remove the tombstones first
+    map.erase(500);
+    standard_map.erase(500);
+    const std::vector<int> erased = { 100, 200, 300 };
+    QVERIFY(map.erase_sorted(erased.cbegin(), erased.cend()) == 2);
+    QVERIFY(map.expire_before(50) == static_cast<std::size_t>(std::distance(standard_map.begin(), standard_map.lower_bound(50))));
+    QVERIFY(map.expire_after(900) == static_cast<std::size_t>(std::distance(standard_map.upper_bound(900), standard_map.end())));
+    for (const int key : erased)
+    {
+        standard_map.erase(key);
+    }
+    standard_map.erase(standard_map.begin(), standard_map.lower_bound(50));
+    standard_map.erase(standard_map.upper_bound(900), standard_map.end());
+    test_map_equality<TestMap, StandardMap>(map, standard_map);
+
+    map.erase(map.begin(), map.end());
+    QVERIFY(map.empty() && map.size() == 0 && map.begin() == map.end());
+    map.compact();
+    QVERIFY(map.memory_consumption() == map.memory_consumption_empty());
+
+    // Extremes are never dead - erased minimum (maximum) is removed together
+    // with the tombstones next to it, so the erasure from the front and back
+    // does not leave the dead prefix (suffix) walked by begin() and end()
+    for (int i = 0; i < 1000; ++i)
+    {
+        map.emplace_hint(map.cend(), i, i);
+        standard_map.emplace(i, i);
+    }
+
+    for (int i = 1; i < 10; ++i)
+    {
+        QVERIFY(map.erase(i) == 1 && map.erase(999 - i) == 1);
+        standard_map.erase(i);
+        standard_map.erase(999 - i);
+    }
+    QVERIFY(map.memory_consumption() == map.memory_consumption_empty() + 1000 * map.memory_consumption_item());
+
+    QVERIFY(map.erase(map.begin())->first == 10);
+    QVERIFY(std::prev(map.end())->first == 999);
+    QVERIFY(map.erase(std::prev(map.end())) == map.end());
+    standard_map.erase(0);
+    standard_map.erase(999);
+    QVERIFY(map.memory_consumption() == map.memory_consumption_empty() + map.size() * map.memory_consumption_item());
+    QVERIFY(map.cbegin()->first == 10 && map.crbegin()->first == 989);
+
+    while (!map.empty())
+    {
+        map.erase((map.size() % 2) ? map.begin() : std::prev(map.end()));
+        standard_map.erase((standard_map.size() % 2) ? standard_map.begin() : std::prev(standard_map.end()));
+
+        QVERIFY(map.memory_consumption() == map.memory_consumption_empty() + map.size() * map.memory_consumption_item());
+        QVERIFY(map.empty() || (map.cbegin()->first == standard_map.cbegin()->first && map.crbegin()->first == standard_map.crbegin()->first));
+    }
+}
+
+void splay_map_test::testDeferredSplay()
+{
+    using TestMap = bushy::splay_map<int, int, counting_less, std::allocator<std::pair<const int, int>>, bushy::splay_map_policy<bushy::splay_mode::NEVER, bushy::splay_mode::DEFERRED>>;
+    using StandardMap = std::map<int, int>;
+
+    // Lookups do not change the tree until the queue is flushed
+    {
+        TestMap map;
+        for (int i = 0; i < 1000; ++i)
+        {
+            map.emplace_hint(map.cend(), i, i);
+        }
+
+        counted_comparisons = 0;
+        QVERIFY(map.find(999)->second == 999);
+        const std::size_t first_comparisons = counted_comparisons;
+
+        counted_comparisons = 0;
+        QVERIFY(map.find(999)->second == 999);
+        QVERIFY(counted_comparisons == first_comparisons);
+
+        map.flush_splays();
+
+        counted_comparisons = 0;
+        QVERIFY(map.find(999)->second == 999);
+        QVERIFY(counted_comparisons <= 2);
+    }
+
+    // Full queue is flushed by the lookup, so the chain is restructured
+    {
+        TestMap map;
+        std::vector<int> keys;
+        for (int i = 0; i < 1000; ++i)
+        {
+            map.emplace_hint(map.cend(), i, i);
+            keys.push_back(i);
+        }
+
+        std::shuffle(keys.begin(), keys.end(), std::minstd_rand(0));
+        for (int key : keys)
+        {
+            QVERIFY(map.find(key)->second == key);
+        }
+
+        counted_comparisons = 0;
+        for (int key : keys)
+        {
+            QVERIFY(map.count(key) == 1);
+        }
+        QVERIFY(counted_comparisons < 100000);
+    }
+
+    // Queued nodes are erased, the map is cleared, copied and moved
+    // with pending splays (sanitizers check the dangling nodes)
+    {
+        TestMap map;
+        StandardMap standard_map;
+
+        std::minstd_rand engine(1);
+        std::uniform_int_distribution<int> distribution(0, 2000);
+
+        for (int i = 0; i < 20000; ++i)
+        {
+            const int key = distribution(engine);
+
+            switch (i % 8)
+            {
+                case 0:
+                case 1:
+                    map.emplace(key, i);
+                    standard_map.emplace(key, i);
+                    break;
+
+                case 2:
+                case 3:
+                    QVERIFY((map.find(key) == map.end()) == (standard_map.find(key) == standard_map.end()));
+                    break;
+
+                case 4:
+                {
+                    TestMap::const_iterator it = map.lower_bound(key);
+                    StandardMap::const_iterator standard_it = standard_map.lower_bound(key);
+                    QVERIFY((it == map.cend()) == (standard_it == standard_map.cend()));
+                    QVERIFY(it == map.cend() || it->first == standard_it->first);
+                    break;
+                }
+
+                case 5:
+                    map.find(key);
+                    QVERIFY(map.erase(key) == standard_map.erase(key));
+                    break;
+
+                case 6:
+                {
+                    TestMap::iterator it = map.upper_bound(key);
+                    if (it != map.end())
+                    {
+                        standard_map.erase(it->first);
+                        map.erase(it);
+                    }
+                    break;
+                }
+
+                case 7:
+                    if (i % 1000 == 7)
+                    {
+                        map.flush_splays();
+                    }
+                    break;
+            }
+
+            QVERIFY(map.size() == standard_map.size());
+        }
+
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+
+        map.find(100);
+        map.find(200);
+        TestMap copy(map);
+        copy.find(300);
+        copy = map;
+        copy.flush_splays();
+        QVERIFY(is_range_equals(copy.cbegin(), copy.cend(), standard_map.cbegin(), standard_map.cend()));
+
+        copy.find(400);
+        TestMap moved(std::move(copy));
+        moved.find(500);
+        moved.swap(map);
+        moved.flush_splays();
+        map.flush_splays();
+        QVERIFY(is_range_equals(moved.cbegin(), moved.cend(), standard_map.cbegin(), standard_map.cend()));
+        QVERIFY(is_range_equals(map.cbegin(), map.cend(), standard_map.cbegin(), standard_map.cend()));
+
+        map.find(600);
+        map.clear();
+        map.flush_splays();
+        QVERIFY(map.empty());
+    }
+}
+
 QTEST_MAIN(splay_map_test)
 
 #include "tst_splay_map_test.moc"